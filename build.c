@@ -41,6 +41,12 @@ static const char* f_verbose = "-v";
 
 #endif
 
+#if defined(_WIN32) || defined(_MSC_VER)
+static const char* f_libs = "";
+#else
+static const char* f_libs = "-pthread";
+#endif
+
 int
 main(int argc, char** argv)
 {
@@ -68,7 +74,7 @@ main(int argc, char** argv)
 	char* end = cmd+sizeof(cmd);
 	char* head = cmd;
 	
-	head += snprintf(head, end-head, "%s %s %s %s", f_cc, sources, f_warnings, f_optimize[g_opts.optimize]);
+	head += snprintf(head, end-head, "%s %s %s %s %s", f_cc, sources, f_warnings, f_optimize[g_opts.optimize], f_libs);
 	if (g_opts.asan)
 		head += snprintf(head, end-head, " -fsanitize=address");
 	if (g_opts.debug_info)
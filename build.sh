@@ -0,0 +1,8 @@
+#!/bin/sh
+
+SOURCES="src/main.c src/os.c src/lang_c.c"
+WARNINGS="-Wall -Wno-unused-function -Wno-gnu-alignof-expression -Wno-missing-braces -Wno-logical-op-parentheses"
+OPTM=
+DEBUG="-g -DDEBUG"
+
+clang -fuse-ld=lld -pthread -o aaa $SOURCES $DEBUG $WARNINGS $OPTM
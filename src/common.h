@@ -13,7 +13,9 @@
 #include "common_buffer.h"
 #include "common_string.h"
 #include "common_string_printf.h"
+#include "common_char.h"
 #include "common_arena.h"
 #include "common_hash.h"
+#include "common_atomic.h"
 
 #endif //COMMON_H
@@ -62,6 +62,7 @@ static String Arena_Printf(Arena* arena, const char* fmt, ...);
 static void         Arena_Pop(Arena* arena, void* ptr);
 static void*        Arena_EndAligned(Arena* arena, uintsize alignment);
 static inline void  Arena_Clear(Arena* arena);
+static void         Arena_Decommit(Arena* arena, uintsize keep);
 static inline void* Arena_End(Arena* arena);
 
 static inline Arena_Savepoint Arena_Save(Arena* arena);
@@ -73,12 +74,32 @@ externC_ void* __stdcall VirtualAlloc(void* base, uintsize size, unsigned long t
 externC_ int32 __stdcall VirtualFree(void* base, uintsize size, unsigned long type);
 #       define Arena_OsReserve_(size) VirtualAlloc(NULL,size,0x00002000/*MEM_RESERVE*/,0x04/*PAGE_READWRITE*/)
 #       define Arena_OsCommit_(ptr, size) VirtualAlloc(ptr,size,0x00001000/*MEM_COMMIT*/,0x04/*PAGE_READWRITE*/)
+#       define Arena_OsDecommit_(ptr, size) VirtualFree(ptr,size,0x00004000/*MEM_DECOMMIT*/)
 #       define Arena_OsFree_(ptr, size) ((void)(size), VirtualFree(ptr,0,0x00008000/*MEM_RELEASE*/))
 #   elif defined(__linux__)
 #       include <sys/mman.h>
-#       define Arena_OsReserve_(size) mmap(NULL,size,PROT_NONE,MAP_ANONYMOUS|MAP_PRIVATE,-1,0)
-#       define Arena_OsCommit_(ptr, size) mprotect(ptr,size,PROT_READ|PROT_WRITE)
+//      NOTE(ljre): mmap() signals failure with MAP_FAILED and mprotect() returns 0 on success, so adapt
+//                  both to the "non-zero means ok" convention the win32 functions follow.
+#       define Arena_OsReserve_(size) Arena_LinuxReserve_(size)
+#       define Arena_OsCommit_(ptr, size) (mprotect(ptr,size,PROT_READ|PROT_WRITE) == 0)
+#       define Arena_OsDecommit_(ptr, size) Arena_LinuxDecommit_(ptr, size)
 #       define Arena_OsFree_(ptr, size) munmap(ptr,size)
+
+static inline void*
+Arena_LinuxReserve_(uintsize size)
+{
+	void* result = mmap(NULL, size, PROT_NONE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+	return (result == MAP_FAILED) ? NULL : result;
+}
+
+// NOTE(ljre): Mapping fresh PROT_NONE pages over the range drops whatever was in it, so it goes back to
+//             being only reserved, like MEM_DECOMMIT does.
+static inline bool
+Arena_LinuxDecommit_(void* ptr, uintsize size)
+{
+	void* result = mmap(ptr, size, PROT_NONE, MAP_ANONYMOUS|MAP_PRIVATE|MAP_FIXED, -1, 0);
+	return result != MAP_FAILED;
+}
 #   endif
 #endif
 
@@ -186,6 +207,24 @@ Arena_PushDirtyAligned(Arena* arena, uintsize size, uintsize alignment)
 	return result;
 }
 
+// NOTE(ljre): Gives committed memory back to the OS, keeping at least 'keep' bytes (and everything that is
+//             in use) committed. Arenas that don't own their memory are left alone.
+static void
+Arena_Decommit(Arena* arena, uintsize keep)
+{
+	if (!arena->page_size)
+		return;
+	
+	uintsize needed = Max(arena->offset, keep) + sizeof(Arena);
+	uintsize to_keep = AlignUp(Max(needed, arena->page_size), arena->page_size-1);
+	
+	if (to_keep >= arena->commited)
+		return;
+	
+	SafeAssert(Arena_OsDecommit_((uint8*)arena + to_keep, arena->commited - to_keep));
+	arena->commited = to_keep;
+}
+
 static void
 Arena_Pop(Arena* arena, void* ptr)
 {
@@ -0,0 +1,139 @@
+#ifndef COMMON_ATOMIC_H
+#define COMMON_ATOMIC_H
+
+// NOTE(ljre): Loads are acquire, stores are release, and read-modify-write operations are sequentially
+//             consistent. CompareExchange returns the value that was in memory before the operation, so
+//             it succeeded iff the result equals 'expected'.
+static inline uint32 Atomic_Load32(volatile uint32* ptr);
+static inline uint64 Atomic_Load64(volatile uint64* ptr);
+static inline void*  Atomic_LoadPtr(void* volatile* ptr);
+
+static inline void Atomic_Store32(volatile uint32* ptr, uint32 value);
+static inline void Atomic_Store64(volatile uint64* ptr, uint64 value);
+static inline void Atomic_StorePtr(void* volatile* ptr, void* value);
+
+static inline uint32 Atomic_FetchAdd32(volatile uint32* ptr, uint32 value);
+static inline uint64 Atomic_FetchAdd64(volatile uint64* ptr, uint64 value);
+
+static inline uint32 Atomic_CompareExchange32(volatile uint32* ptr, uint32 expected, uint32 desired);
+static inline uint64 Atomic_CompareExchange64(volatile uint64* ptr, uint64 expected, uint64 desired);
+static inline void*  Atomic_CompareExchangePtr(void* volatile* ptr, void* expected, void* desired);
+
+static inline void Atomic_Pause(void);
+
+#if defined(__GNUC__) || defined(__clang__)
+
+static inline uint32
+Atomic_Load32(volatile uint32* ptr)
+{ return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+
+static inline uint64
+Atomic_Load64(volatile uint64* ptr)
+{ return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+
+static inline void*
+Atomic_LoadPtr(void* volatile* ptr)
+{ return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+
+static inline void
+Atomic_Store32(volatile uint32* ptr, uint32 value)
+{ __atomic_store_n(ptr, value, __ATOMIC_RELEASE); }
+
+static inline void
+Atomic_Store64(volatile uint64* ptr, uint64 value)
+{ __atomic_store_n(ptr, value, __ATOMIC_RELEASE); }
+
+static inline void
+Atomic_StorePtr(void* volatile* ptr, void* value)
+{ __atomic_store_n(ptr, value, __ATOMIC_RELEASE); }
+
+static inline uint32
+Atomic_FetchAdd32(volatile uint32* ptr, uint32 value)
+{ return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST); }
+
+static inline uint64
+Atomic_FetchAdd64(volatile uint64* ptr, uint64 value)
+{ return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST); }
+
+static inline uint32
+Atomic_CompareExchange32(volatile uint32* ptr, uint32 expected, uint32 desired)
+{
+	__atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return expected;
+}
+
+static inline uint64
+Atomic_CompareExchange64(volatile uint64* ptr, uint64 expected, uint64 desired)
+{
+	__atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return expected;
+}
+
+static inline void*
+Atomic_CompareExchangePtr(void* volatile* ptr, void* expected, void* desired)
+{
+	__atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return expected;
+}
+
+static inline void
+Atomic_Pause(void)
+{ __builtin_ia32_pause(); }
+
+#elif defined(_MSC_VER)
+
+#include <intrin.h>
+
+// NOTE(ljre): On amd64, plain loads already have acquire semantics and plain stores have release
+//             semantics. We just need to stop the compiler from reordering around them.
+static inline uint32
+Atomic_Load32(volatile uint32* ptr)
+{ uint32 result = *ptr; _ReadWriteBarrier(); return result; }
+
+static inline uint64
+Atomic_Load64(volatile uint64* ptr)
+{ uint64 result = *ptr; _ReadWriteBarrier(); return result; }
+
+static inline void*
+Atomic_LoadPtr(void* volatile* ptr)
+{ void* result = *ptr; _ReadWriteBarrier(); return result; }
+
+static inline void
+Atomic_Store32(volatile uint32* ptr, uint32 value)
+{ _ReadWriteBarrier(); *ptr = value; }
+
+static inline void
+Atomic_Store64(volatile uint64* ptr, uint64 value)
+{ _ReadWriteBarrier(); *ptr = value; }
+
+static inline void
+Atomic_StorePtr(void* volatile* ptr, void* value)
+{ _ReadWriteBarrier(); *ptr = value; }
+
+static inline uint32
+Atomic_FetchAdd32(volatile uint32* ptr, uint32 value)
+{ return (uint32)_InterlockedExchangeAdd((volatile long*)ptr, (long)value); }
+
+static inline uint64
+Atomic_FetchAdd64(volatile uint64* ptr, uint64 value)
+{ return (uint64)_InterlockedExchangeAdd64((volatile __int64*)ptr, (__int64)value); }
+
+static inline uint32
+Atomic_CompareExchange32(volatile uint32* ptr, uint32 expected, uint32 desired)
+{ return (uint32)_InterlockedCompareExchange((volatile long*)ptr, (long)desired, (long)expected); }
+
+static inline uint64
+Atomic_CompareExchange64(volatile uint64* ptr, uint64 expected, uint64 desired)
+{ return (uint64)_InterlockedCompareExchange64((volatile __int64*)ptr, (__int64)desired, (__int64)expected); }
+
+static inline void*
+Atomic_CompareExchangePtr(void* volatile* ptr, void* expected, void* desired)
+{ return _InterlockedCompareExchangePointer(ptr, desired, expected); }
+
+static inline void
+Atomic_Pause(void)
+{ _mm_pause(); }
+
+#endif
+
+#endif //COMMON_ATOMIC_H
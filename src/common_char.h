@@ -0,0 +1,151 @@
+#ifndef COMMON_CHAR_H
+#define COMMON_CHAR_H
+
+//~ NOTE(ljre): ASCII character classes
+//
+// Lexers hit these for every byte of input, so instead of chains of range comparisons every class is
+// a bit in a 256-entry table. Anything >= 0x80 has no class.
+enum
+{
+	Char_Blank = 1 << 0, // space, \t, \r
+	Char_LineBreak = 1 << 1, // \n
+	Char_IdentStart = 1 << 2, // [A-Za-z_]
+	Char_Ident = 1 << 3, // [A-Za-z_0-9]
+	Char_Digit = 1 << 4, // [0-9]
+	Char_OctDigit = 1 << 5, // [0-7]
+	Char_BinDigit = 1 << 6, // [01]
+	Char_HexDigit = 1 << 7, // [0-9A-Fa-f]
+};
+
+static const uint8 Char_Table[256] = {
+	['\t'] = Char_Blank,
+	['\n'] = Char_LineBreak,
+	['\r'] = Char_Blank,
+	[' '] = Char_Blank,
+	['0'] = Char_Ident | Char_Digit | Char_OctDigit | Char_BinDigit | Char_HexDigit,
+	['1'] = Char_Ident | Char_Digit | Char_OctDigit | Char_BinDigit | Char_HexDigit,
+	['2'] = Char_Ident | Char_Digit | Char_OctDigit | Char_HexDigit,
+	['3'] = Char_Ident | Char_Digit | Char_OctDigit | Char_HexDigit,
+	['4'] = Char_Ident | Char_Digit | Char_OctDigit | Char_HexDigit,
+	['5'] = Char_Ident | Char_Digit | Char_OctDigit | Char_HexDigit,
+	['6'] = Char_Ident | Char_Digit | Char_OctDigit | Char_HexDigit,
+	['7'] = Char_Ident | Char_Digit | Char_OctDigit | Char_HexDigit,
+	['8'] = Char_Ident | Char_Digit | Char_HexDigit,
+	['9'] = Char_Ident | Char_Digit | Char_HexDigit,
+	['A'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['B'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['C'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['D'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['E'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['F'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['G'] = Char_IdentStart | Char_Ident,
+	['H'] = Char_IdentStart | Char_Ident,
+	['I'] = Char_IdentStart | Char_Ident,
+	['J'] = Char_IdentStart | Char_Ident,
+	['K'] = Char_IdentStart | Char_Ident,
+	['L'] = Char_IdentStart | Char_Ident,
+	['M'] = Char_IdentStart | Char_Ident,
+	['N'] = Char_IdentStart | Char_Ident,
+	['O'] = Char_IdentStart | Char_Ident,
+	['P'] = Char_IdentStart | Char_Ident,
+	['Q'] = Char_IdentStart | Char_Ident,
+	['R'] = Char_IdentStart | Char_Ident,
+	['S'] = Char_IdentStart | Char_Ident,
+	['T'] = Char_IdentStart | Char_Ident,
+	['U'] = Char_IdentStart | Char_Ident,
+	['V'] = Char_IdentStart | Char_Ident,
+	['W'] = Char_IdentStart | Char_Ident,
+	['X'] = Char_IdentStart | Char_Ident,
+	['Y'] = Char_IdentStart | Char_Ident,
+	['Z'] = Char_IdentStart | Char_Ident,
+	['_'] = Char_IdentStart | Char_Ident,
+	['a'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['b'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['c'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['d'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['e'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['f'] = Char_IdentStart | Char_Ident | Char_HexDigit,
+	['g'] = Char_IdentStart | Char_Ident,
+	['h'] = Char_IdentStart | Char_Ident,
+	['i'] = Char_IdentStart | Char_Ident,
+	['j'] = Char_IdentStart | Char_Ident,
+	['k'] = Char_IdentStart | Char_Ident,
+	['l'] = Char_IdentStart | Char_Ident,
+	['m'] = Char_IdentStart | Char_Ident,
+	['n'] = Char_IdentStart | Char_Ident,
+	['o'] = Char_IdentStart | Char_Ident,
+	['p'] = Char_IdentStart | Char_Ident,
+	['q'] = Char_IdentStart | Char_Ident,
+	['r'] = Char_IdentStart | Char_Ident,
+	['s'] = Char_IdentStart | Char_Ident,
+	['t'] = Char_IdentStart | Char_Ident,
+	['u'] = Char_IdentStart | Char_Ident,
+	['v'] = Char_IdentStart | Char_Ident,
+	['w'] = Char_IdentStart | Char_Ident,
+	['x'] = Char_IdentStart | Char_Ident,
+	['y'] = Char_IdentStart | Char_Ident,
+	['z'] = Char_IdentStart | Char_Ident,
+};
+
+static inline bool Char_Is(uint8 ch, uint8 classes);
+static inline uint8 Char_DigitClassForBase(int32 base);
+static inline const uint8* Char_SkipIdent(const uint8* head, const uint8* end);
+
+//~ NOTE(ljre): Implementation
+static inline bool
+Char_Is(uint8 ch, uint8 classes)
+{ return (Char_Table[ch] & classes) != 0; }
+
+static inline uint8
+Char_DigitClassForBase(int32 base)
+{
+	switch (base)
+	{
+		case 2: return Char_BinDigit;
+		case 8: return Char_OctDigit;
+		case 10: return Char_Digit;
+		case 16: return Char_HexDigit;
+	}
+	
+	Assert(false);
+	return 0;
+}
+
+// NOTE(ljre): Returns the first byte in [head, end) that isn't an identifier char.
+static inline const uint8*
+Char_SkipIdent(const uint8* head, const uint8* end)
+{
+	// NOTE(ljre): XMM by XMM. Bytes >= 0x80 are negative, so the signed compares below reject them.
+	{
+		__m128i digit_min = _mm_set1_epi8('0' - 1);
+		__m128i digit_max = _mm_set1_epi8('9' + 1);
+		__m128i alpha_min = _mm_set1_epi8('a' - 1);
+		__m128i alpha_max = _mm_set1_epi8('z' + 1);
+		__m128i lower_bit = _mm_set1_epi8(0x20);
+		__m128i underscore = _mm_set1_epi8('_');
+		
+		while (head + 16 <= end)
+		{
+			__m128i data = _mm_loadu_si128((const __m128i*)head);
+			__m128i lower = _mm_or_si128(data, lower_bit);
+			
+			__m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(data, digit_min), _mm_cmplt_epi8(data, digit_max));
+			__m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, alpha_min), _mm_cmplt_epi8(lower, alpha_max));
+			__m128i is_ident = _mm_or_si128(_mm_or_si128(is_digit, is_alpha), _mm_cmpeq_epi8(data, underscore));
+			uint32 not_ident = ~(uint32)_mm_movemask_epi8(is_ident) & 0xffff;
+			
+			if (Likely(not_ident != 0))
+				return head + Mem_BitCtz32(not_ident);
+			
+			head += 16;
+		}
+	}
+	
+	// NOTE(ljre): Byte by byte
+	while (head < end && Char_Is(head[0], Char_Ident))
+		++head;
+	
+	return head;
+}
+
+#endif //COMMON_CHAR_H
@@ -57,4 +57,95 @@ Hash_Msi(uint32 log2_of_cap, uint64 hash, int32 index)
 	return (index + step) & mask;
 }
 
+//~ NOTE(ljre): Perfect hash for small sets of keywords
+//
+// A keyword is told apart by its length and its first, middle and last chars, packed into a 32-bit key.
+// Building the table looks for a multiplier that sends every keyword's key to a different slot, so a
+// lookup is a single multiply, a single probe and a compare of at most 'Hash_KEYWORD_MAX_SIZE' bytes.
+//
+// Build it once at startup (before any threads are spawned) and then only read from it.
+enum { Hash_KEYWORD_MAX_SIZE = 14 };
+
+struct Hash_KeywordTable
+{
+	uint32 seed;
+	
+	struct
+	{
+		uint8 size;
+		uint8 value;
+		char name[Hash_KEYWORD_MAX_SIZE];
+	}
+	slots[256];
+}
+typedef Hash_KeywordTable;
+
+static inline uint32
+Hash_KeywordKey(String str)
+{
+	Assert(str.size > 0);
+	
+	uint32 first = str.data[0];
+	uint32 middle = str.data[str.size / 2];
+	uint32 last = str.data[str.size - 1];
+	
+	return (uint32)str.size | first << 8 | middle << 16 | last << 24;
+}
+
+static inline uint32
+Hash_KeywordSlot(uint32 seed, uint32 key)
+{ return (key * seed) >> 24; }
+
+// NOTE(ljre): 'values' must be non-zero, since zero means "not a keyword". Returns false if no seed was
+//             found, which means some keywords are indistinguishable by length, first, middle and last
+//             chars.
+static bool
+Hash_BuildKeywordTable(Hash_KeywordTable* table, const String* names, const uint8* values, uint32 count)
+{
+	uint32 seed = 0x9e3779b1;
+	
+	for (int32 tries = 0; tries < (1 << 20); ++tries)
+	{
+		Mem_Zero(table, sizeof(*table));
+		table->seed = seed;
+		
+		bool ok = true;
+		for (uint32 i = 0; i < count && ok; ++i)
+		{
+			Assert(names[i].size > 0 && names[i].size <= Hash_KEYWORD_MAX_SIZE && values[i] != 0);
+			uint32 slot = Hash_KeywordSlot(seed, Hash_KeywordKey(names[i]));
+			
+			if (table->slots[slot].size)
+				ok = false;
+			else
+			{
+				table->slots[slot].size = (uint8)names[i].size;
+				table->slots[slot].value = values[i];
+				Mem_Copy(table->slots[slot].name, names[i].data, names[i].size);
+			}
+		}
+		
+		if (ok)
+			return true;
+		
+		seed = (seed + 0x3c6ef372) | 1;
+	}
+	
+	return false;
+}
+
+static inline uint8
+Hash_FindKeyword(const Hash_KeywordTable* table, String str)
+{
+	if (str.size == 0 || str.size > Hash_KEYWORD_MAX_SIZE)
+		return 0;
+	
+	uint32 slot = Hash_KeywordSlot(table->seed, Hash_KeywordKey(str));
+	
+	if (table->slots[slot].size != str.size || Mem_Compare(table->slots[slot].name, str.data, str.size) != 0)
+		return 0;
+	
+	return table->slots[slot].value;
+}
+
 #endif //COMMON_HASH_H
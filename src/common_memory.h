@@ -31,6 +31,7 @@ static inline void Mem_Copy128Ax4(void* dst, const void* src, uintsize count);
 static inline uintsize Mem_Strlen(const char* restrict cstr);
 static inline int32 Mem_Strcmp(const char* left, const char* right);
 static inline const void* Mem_FindByte(const void* buffer, uint8 byte, uintsize size);
+static inline uintsize Mem_CountByte(const void* buffer, uint8 byte, uintsize size);
 static inline void* Mem_Zero(void* restrict dst, uintsize size);
 static inline void* Mem_ZeroSafe(void* restrict dst, uintsize size);
 
@@ -364,6 +365,49 @@ Mem_ZeroSafe(void* restrict dst, uintsize size)
 #   pragma optimize("", on)
 #endif
 
+//- Mem_CountByte
+static inline uintsize
+Mem_CountByte(const void* buffer, uint8 byte, uintsize size)
+{
+	const uint8* buf = (const uint8*)buffer;
+	const uint8* const end = buf + size;
+	uintsize count = 0;
+	
+	// NOTE(ljre): XMM by XMM. Each byte of 'acc' counts matches in its lane, so it's summed up before
+	//             it can overflow.
+	{
+		__m128i mask = _mm_set1_epi8(byte);
+		__m128i zero = _mm_setzero_si128();
+		
+		while (buf + 16 <= end)
+		{
+			uintsize blocks = Min((uintsize)(end - buf) / 16, 255);
+			__m128i acc = zero;
+			
+#ifdef __clang__
+#   pragma clang loop vectorize(disable)
+#endif
+			for (uintsize i = 0; i < blocks; ++i, buf += 16)
+			{
+				__m128i data = _mm_loadu_si128((const __m128i*)buf);
+				acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(data, mask));
+			}
+			
+			__m128i sums = _mm_sad_epu8(acc, zero);
+			count += (uintsize)_mm_cvtsi128_si64(sums) + (uintsize)_mm_extract_epi16(sums, 4);
+		}
+	}
+	
+	// NOTE(ljre): Byte by byte
+#ifdef __clang__
+#   pragma clang loop vectorize(disable)
+#endif
+	while (buf < end)
+		count += (*buf++ == byte);
+	
+	return count;
+}
+
 //- CRT memcpy, memmove, memset & memcmp functions
 #ifdef COMMON_DONT_USE_CRT
 
@@ -558,6 +602,10 @@ Mem_Move(void* dst, const void* src, uintsize size)
 #if defined(__clang__) || defined(__GNUC__) || defined(_MSC_VER)
 		if (Unlikely(size >= 2048))
 		{
+			// NOTE(ljre): With the direction flag set, both pointers have to start at the last byte.
+			d += size - 1;
+			s += size - 1;
+			
 #   if defined(__clang__) || defined(__GNUC__)
 			__asm__ __volatile__("std\n"
 				"rep movsb\n"
@@ -568,7 +616,7 @@ Mem_Move(void* dst, const void* src, uintsize size)
 			// TODO(ljre): maybe reconsider this? I couldn't find a way for MSVC to directly
 			//     generate 'std' & 'cld' instructions. (SeT Direction flag & CLear Direction flag)
 			__writeeflags(__readeflags() | 0x0400);
-			__movsb(dst, src, size);
+			__movsb(d, s, size);
 			__writeeflags(__readeflags() & ~(uint64)0x0400);
 #   endif
 			return dst;
@@ -271,7 +271,7 @@ String_PrintfFunc_(char* buf, uintsize buf_size, const char* restrict fmt, va_li
 					}
 				} break;
 				
-				case 'x': case 'X':
+				case 'x':
 				{
 					uint32 arg = va_arg(args, uint32);
 					
@@ -288,6 +288,23 @@ String_PrintfFunc_(char* buf, uintsize buf_size, const char* restrict fmt, va_li
 					}
 				} break;
 				
+				case 'X':
+				{
+					uint64 arg = va_arg(args, uint64);
+					
+					if (arg == 0)
+					{
+						count += 1;
+						break;
+					}
+					
+					while (arg > 0)
+					{
+						++count;
+						arg >>= 4;
+					}
+				} break;
+				
 				case 's':
 				{
 					const char* arg = va_arg(args, const char*);
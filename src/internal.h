@@ -34,14 +34,67 @@ struct OS_Error
 }
 typedef OS_Error;
 
+struct OS_FileInfo
+{
+	uint64 size;
+	// NOTE(ljre): Same unit as OS_GetPosixTimestamp.
+	uint64 modified_time;
+	// NOTE(ljre): Together they identify the file itself, no matter through which path it was reached.
+	//             Device and inode on Linux, volume serial number and file index on Windows.
+	uint64 device;
+	uint64 inode;
+}
+typedef OS_FileInfo;
+
 API bool OS_ReadWholeFile(String path, String* out_data, Arena* out_arena, OS_Error* out_err);
 API bool OS_WriteWholeFile(String path, String data, Arena* scratch_arena, OS_Error* out_err);
+API bool OS_GetFileInfo(String path, OS_FileInfo* out_info, Arena* scratch_arena, OS_Error* out_err);
+API bool OS_RenameFile(String from, String to, Arena* scratch_arena, OS_Error* out_err);
+// NOTE(ljre): Also succeeds if 'path' already is a directory. Parent directories aren't created.
+API bool OS_CreateDirectory(String path, Arena* scratch_arena, OS_Error* out_err);
+// NOTE(ljre): Every entry of a directory, except "." and "..". Both the names and the array are pushed
+//             to 'output_arena'.
+API bool OS_ListDirectory(String path, String** out_names, uintsize* out_count, Arena* output_arena, OS_Error* out_err);
 API uint64 OS_GetPosixTimestamp(void);
 API bool OS_PrintStderr(String data, Arena* scratch_arena, OS_Error* out_err);
 API bool OS_PrintStdout(String data, Arena* scratch_arena, OS_Error* out_err);
 API String OS_ResolveFullPath(String path, Arena* output_arena, OS_Error* out_err);
+
+// NOTE(ljre): A file that is written a piece at a time. The one from OS_GetStdout doesn't need to be
+//             closed, but closing it is harmless.
+struct OS_File
+{
+	uintptr handle;
+}
+typedef OS_File;
+
+API bool OS_OpenFileForWriting(String path, OS_File* out_file, Arena* scratch_arena, OS_Error* out_err);
+API OS_File OS_GetStdout(void);
+API bool OS_WriteFile(OS_File file, String data, OS_Error* out_err);
+API void OS_CloseFile(OS_File file);
 API void OS_SplitPath(String fullpath, String* out_folder, String* out_file);
 
+typedef int32 OS_ThreadProc(void* user_data);
+
+// NOTE(ljre): The OS_Thread struct is passed to the new thread, so it needs to stay alive (and in the same
+//             place) until OS_JoinThread returns.
+struct OS_Thread
+{
+	uintptr handle;
+	OS_ThreadProc* proc;
+	void* user_data;
+}
+typedef OS_Thread;
+
+API bool OS_CreateThread(OS_Thread* thread, OS_ThreadProc* proc, void* user_data, OS_Error* out_err);
+API int32 OS_JoinThread(OS_Thread* thread);
+// NOTE(ljre): Sleeps while '*address == value', which is checked atomically with going to sleep. Might
+//             return spuriously, so the caller should always check its condition again.
+API void OS_WaitOnAddress(volatile uint32* address, uint32 value);
+API void OS_WakeAllOnAddress(volatile uint32* address);
+API int32 OS_GetProcessorCount(void);
+API uint32 OS_GetProcessId(void);
+
 //- X API
 API int32 X_Main(int32 argc, const char* const* argv);
 
@@ -50,26 +50,21 @@ C_IsOk(const C_Error* error)
 	return error->what.size == 0;
 }
 
-static inline C_HashMapChunk*
-C_AllocHashMapChunk(Arena* arena, uint32 log2cap, uint32 obj_size)
-{
-	C_HashMapChunk* map = Arena_Push(arena, sizeof(C_HashMapChunk) + obj_size * (1 << log2cap));
-	map->log2cap = log2cap;
-	return map;
-}
-
-#include "lang_c_log.c"
 #include "lang_c_token.c"
+#include "lang_c_log.c"
+#include "lang_c_token_cache.c"
 #include "lang_c_preproc.c"
 #include "lang_c_parser.c"
+#include "lang_c_driver.c"
 
 API int32
 C_Main(int32 argc, const char* const* argv)
 {
-	//- basic options
-	String filename = StrInit("tests/pp-test.c");
+	Arena* driver_arena = Arena_Create(64ull << 20, 1ull << 20);
+	C_InitKeywordTable();
 	
-	const String include_dirs[] = {
+	//- basic options
+	const String default_include_dirs[] = {
 		StrInit("include/"),
 	};
 	
@@ -82,8 +77,8 @@ C_Main(int32 argc, const char* const* argv)
 	C_CompilerOptions options = {
 		.warnings = { 0 },
 		
-		.include_dirs = include_dirs,
-		.include_dirs_count = ArrayLength(include_dirs),
+		.include_dirs = default_include_dirs,
+		.include_dirs_count = ArrayLength(default_include_dirs),
 		
 		.predefined_macros = predefined_macros,
 		.predefined_macros_count = ArrayLength(predefined_macros),
@@ -113,40 +108,154 @@ C_Main(int32 argc, const char* const* argv)
 		},
 	};
 	
-	C_TuContext tu = {
-		.loc_arena = Arena_Create(512ull << 20, 8ull << 20),
-		.array_arena = Arena_Create(512ull << 20, 8ull << 20),
-		.tree_arena = Arena_Create(512ull << 20, 8ull << 20),
-		.stage_arena = Arena_Create(512ull << 20, 8ull << 20),
-		.scratch_arena = Arena_Create(512ull << 20, 8ull << 20),
-		
-		.main_file_name = filename,
+	C_Driver driver = {
 		.options = &options,
+		.file_cache = C_CreateFileCache(driver_arena, 17),
+		.include_cache = C_CreateIncludeCache(driver_arena, 14),
+		.symbol_table = C_CreateSymbolTable(driver_arena, 20),
 	};
 	
-	//- preprocess
-	if (tu.error_count == 0)
-		C_Preprocess(&tu);
+	//- parse command line
+	// NOTE(ljre): Usage: [-v] [-j<threads>] [-I<dir>]... [-D<name>[=<value>]]... [-U<name>]...
+	//                    [-ftoken-cache=<dir>] [-o <output>] <input files>...
+	//             Every input file foo.c is preprocessed into foo.i, unless -o is given with a single input.
+	//             '-o -' writes to the standard output.
+	//             Every -U is applied after every -D, no matter the order.
+	String* include_dirs = Arena_PushArray(driver_arena, String, argc);
+	uint32 include_dirs_count = 0;
+	// NOTE(ljre): The defaults come first, so they can be redefined.
+	String* defines = Arena_PushArray(driver_arena, String, argc + ArrayLength(predefined_macros));
+	uint32 defines_count = ArrayLength(predefined_macros);
+	Mem_Copy(defines, predefined_macros, sizeof(predefined_macros));
+	String* undefines = Arena_PushArray(driver_arena, String, argc);
+	uint32 undefines_count = 0;
+	C_DriverJob* jobs = Arena_PushArray(driver_arena, C_DriverJob, argc + 1);
+	uint32 job_count = 0;
+	String output_path = StrNull;
+	int32 worker_count = 0;
 	
-	String str = C_WritePreprocessedTokensGnu(&tu, tu.scratch_arena);
-	OS_WriteWholeFile(Str("tests/pp-tested.c"), str, tu.scratch_arena, NULL);
+	for (int32 i = 1; i < argc; ++i)
+	{
+		String arg = StrMake(Mem_Strlen(argv[i]), argv[i]);
+		
+		if (arg.size >= 2 && arg.data[0] == '-' && arg.data[1] == 'I')
+		{
+			String dir = StrMake(arg.size - 2, arg.data + 2);
+			if (dir.size == 0 && i+1 < argc)
+				dir = StrMake(Mem_Strlen(argv[i+1]), argv[++i]);
+			
+			include_dirs[include_dirs_count++] = dir;
+		}
+		else if (arg.size >= 2 && arg.data[0] == '-' && (arg.data[1] == 'D' || arg.data[1] == 'U'))
+		{
+			String name = StrMake(arg.size - 2, arg.data + 2);
+			if (name.size == 0 && i+1 < argc)
+				name = StrMake(Mem_Strlen(argv[i+1]), argv[++i]);
+			
+			if (name.size == 0)
+				C_LogFmt(driver_arena, "warning: missing macro name after '%S'.\n", arg);
+			else if (arg.data[1] == 'U')
+				undefines[undefines_count++] = name;
+			else
+			{
+				// NOTE(ljre): '-DX=Y' is '#define X Y', and a plain '-DX' is '#define X 1'.
+				const uint8* equals = Mem_FindByte(name.data, '=', name.size);
+				
+				if (equals)
+					name = Arena_Printf(driver_arena, "%S %S", StrRange(name.data, equals), StrRange(equals + 1, name.data + name.size));
+				else
+					name = Arena_Printf(driver_arena, "%S 1", name);
+				
+				defines[defines_count++] = name;
+			}
+		}
+		else if (String_Equals(arg, Str("-v")))
+			driver.verbose = true;
+		else if (arg.size > 2 && arg.data[0] == '-' && arg.data[1] == 'j')
+		{
+			uint64 value;
+			if (!C_TokenizeInt(driver_arena, StrMake(arg.size - 2, arg.data + 2), &value) || value == 0)
+				C_LogFmt(driver_arena, "warning: invalid thread count in '%S'.\n", arg);
+			else
+				worker_count = (int32)Min(value, INT32_MAX);
+		}
+		else if (arg.size > 14 && Mem_Compare(arg.data, "-ftoken-cache=", 14) == 0)
+			options.token_cache_dir = StrMake(arg.size - 14, arg.data + 14);
+		else if (String_Equals(arg, Str("-o")) && i+1 < argc)
+			output_path = StrMake(Mem_Strlen(argv[i+1]), argv[++i]);
+		else if (arg.size > 0 && arg.data[0] == '-')
+			C_LogFmt(driver_arena, "warning: unknown option '%S'.\n", arg);
+		else
+		{
+			String output = arg;
+			for (intsize j = arg.size-1; j >= 0 && arg.data[j] != '/' && arg.data[j] != '\\'; --j)
+			{
+				if (arg.data[j] == '.')
+				{
+					output.size = j;
+					break;
+				}
+			}
+			
+			jobs[job_count++] = (C_DriverJob) {
+				.input_path = arg,
+				.output_path = Arena_Printf(driver_arena, "%S.i", output),
+			};
+		}
+	}
+	
+	// NOTE(ljre): With no inputs, fall back to the test file.
+	if (job_count == 0)
+		jobs[job_count++] = (C_DriverJob) { Str("tests/pp-test.c"), Str("tests/pp-tested.c") };
+	
+	if (output_path.size > 0)
+	{
+		if (job_count == 1)
+			jobs[0].output_path = output_path;
+		else
+			C_LogFmt(driver_arena, "warning: ignoring '-o' with multiple input files.\n");
+	}
 	
-	//if (tu.error_count == 0)
-	//C_Parse(&tu);
+	if (defines_count > ArrayLength(predefined_macros) || undefines_count > 0)
+	{
+		options.predefined_macros = defines;
+		options.predefined_macros_count = defines_count;
+		options.undefined_macros = undefines;
+		options.undefined_macros_count = undefines_count;
+	}
 	
-	//C_PrintAllErrorsAndWarnings(&tu);
+	// NOTE(ljre): The cache dir is created here, once, so nothing else has to check whether it exists.
+	if (options.token_cache_dir.size > 0)
+	{
+		OS_Error err;
+		
+		if (!OS_CreateDirectory(options.token_cache_dir, driver_arena, &err))
+		{
+			C_LogFmt(driver_arena, "warning: could not create token cache dir '%S' (%S), the token cache is disabled.\n", options.token_cache_dir, err.why);
+			options.token_cache_dir = StrNull;
+		}
+	}
 	
-	if (true)
+	if (include_dirs_count > 0)
 	{
-		C_LogFmt(tu.scratch_arena, "[MEMORY USAGE]\n");
-		C_LogFmt(tu.scratch_arena, "\tloc_arena:     %z of %z\n", tu.loc_arena->offset, tu.loc_arena->commited);
-		C_LogFmt(tu.scratch_arena, "\tarray_arena:   %z of %z\n", tu.array_arena->offset, tu.array_arena->commited);
-		C_LogFmt(tu.scratch_arena, "\ttree_arena:    %z of %z\n", tu.tree_arena->offset, tu.tree_arena->commited);
-		C_LogFmt(tu.scratch_arena, "\tstage_arena:  %z of %z\n", tu.stage_arena->offset, tu.stage_arena->commited);
-		C_LogFmt(tu.scratch_arena, "\tscratch_arena: %z of %z\n", tu.scratch_arena->offset, tu.scratch_arena->commited);
+		options.include_dirs = include_dirs;
+		options.include_dirs_count = include_dirs_count;
 	}
 	
-	Debugbreak();
+	if (worker_count <= 0)
+		worker_count = OS_GetProcessorCount();
+	
+	driver.jobs = jobs;
+	driver.job_count = job_count;
+	driver.worker_count = (uint32)Min(worker_count, job_count);
+	// NOTE(ljre): Only worth it if there are processors left over.
+	driver.pipeline_output = (driver.worker_count < (uint32)OS_GetProcessorCount());
+	driver.workers = Arena_PushArray(driver_arena, C_Worker, driver.worker_count);
+	driver.arena_pool.count = driver.worker_count;
+	driver.arena_pool.sets = Arena_PushArray(driver_arena, C_TuArenas, driver.worker_count);
+	
+	//- compile
+	uint32 failed_count = C_RunDriver(&driver);
 	
-	return 0;
+	return (failed_count > 0) ? 1 : 0;
 }
@@ -1,17 +1,9 @@
 #ifndef LANG_C_DEFS_H
 #define LANG_C_DEFS_H
 
-struct C_SourceLocation typedef C_SourceLocation;
-
-//~ NOTE(ljre): Generic stuff
-struct C_HashMapChunk typedef C_HashMapChunk;
-struct C_HashMapChunk
-{
-	C_HashMapChunk* next;
-	
-	uint32 size, log2cap;
-	uint8 memory[];
-};
+// NOTE(ljre): See "Source location" below.
+typedef uint32 C_SourceLoc;
+struct C_LineIndex typedef C_LineIndex;
 
 //~ NOTE(ljre): Token kinds
 enum C_TokenKind
@@ -97,6 +89,7 @@ enum C_TokenKind
 	C_TokenKind__LastEncodesString = C_TokenKind_Identifier,
 	
 	C_TokenKind_UnclosedQuote, // NOTE(ljre): Error state. Needed because #warning what's up
+	C_TokenKind_Other, // NOTE(ljre): Any other byte, like '@' or '`'. Fine as long as it's never parsed
 	
 	C_TokenKind_LeftParen, // (
 	C_TokenKind_RightParen, // )
@@ -209,31 +202,114 @@ X("__attribute__", C_TokenKind_GccAttribute) \
 X("__extension__", C_TokenKind_GccExtension) \
 X("__forceinline", C_TokenKind_MsvcForceinline) \
 
+//~ NOTE(ljre): Symbols
+// NOTE(ljre): Every distinct identifier gets an ID the first time it's lexed, and the same ID in every
+//             TU on every thread. Keywords are interned first and in order, so a keyword's ID is its
+//             C_TokenKind. The identifiers the preprocessor cares about come right after them.
+typedef uint32 C_SymbolId;
+
+#define C_GEN_KNOWN_SYMBOL_TABLE(X) \
+X("define", Define) \
+X("undef", Undef) \
+X("include", Include) \
+X("ifdef", Ifdef) \
+X("ifndef", Ifndef) \
+X("elif", Elif) \
+X("endif", Endif) \
+X("error", Error) \
+X("warning", Warning) \
+X("pragma", Pragma) \
+X("line", Line) \
+X("defined", Defined) \
+X("__VA_ARGS__", VaArgs) \
+X("__LINE__", LineMacro) \
+X("__FILE__", FileMacro) \
+X("_Pragma", PragmaOperator) \
+X("once", Once) \
+
+enum C_KnownSymbol
+{
+	C_KnownSymbol_Null = 0,
+	
+	C_KnownSymbol__AfterKeywords = C_TokenKind__LastKeyword,
+#define X(name, id) C_KnownSymbol_##id,
+	C_GEN_KNOWN_SYMBOL_TABLE(X)
+#undef X
+	
+	C_KnownSymbol__End,
+}
+typedef C_KnownSymbol;
+
+struct C_Symbol
+{
+	uint64 hash;
+	String name;
+	volatile C_SymbolId id; // NOTE(ljre): 0 for a moment after it's published, see C_InternSymbolInTable
+}
+typedef C_Symbol;
+
+// NOTE(ljre): Process-wide and lock-free, just like C_FileCache. Tables are never resized; once one is
+//             3/4 full, new symbols go to 'next', which is twice as big. IDs come from the first table's
+//             'next_id' and are only taken by the insert that wins its slot, so they're dense.
+struct C_SymbolTable
+{
+	uint32 log2cap;
+	volatile uint32 next_id;
+	// NOTE(ljre): Slots reserved so far in the low 32 bits, and how many of those are still being inserted
+	//             in the high 32 bits.
+	volatile uint64 reservations;
+	struct C_SymbolTable* volatile next;
+	
+	C_Symbol* volatile slots[];
+}
+typedef C_SymbolTable;
+
 //~ NOTE(ljre): Preprocessor
 struct C_PreprocToken
 {
 	C_TokenKind kind;
 	uint32 leading_spaces;
-	uint32 line, col;
+	C_SymbolId symbol; // NOTE(ljre): Only for identifiers, 0 otherwise
 	String as_string;
 }
 typedef C_PreprocToken;
 
-struct C_PreprocHideset typedef C_PreprocHideset;
+// NOTE(ljre): Every token of a file, stored as parallel arrays indexed by token. Token strings are
+//             slices of 'source'. There's no line nor column in here, see C_LineIndex.
+struct C_PreprocTokenArray
+{
+	String source;
+	uint32 size;
+	
+	uint8* kinds;
+	uint16* leading_spaces;
+	uint32* str_offsets;
+	uint32* str_sizes;
+	C_SymbolId* symbols;
+}
+typedef C_PreprocTokenArray;
+
+static_assert(C_TokenKind__Count <= 256);
+
+// NOTE(ljre): Set of macros that must not be expanded again, as a sorted array of symbols. Hidesets are
+//             hash-consed and immutable, so equal sets are the same pointer and NULL is the empty set.
 struct C_PreprocHideset
 {
-	C_PreprocHideset* next;
-	String name;
-};
+	uint64 hash;
+	uint32 count;
+	C_SymbolId symbols[];
+}
+typedef C_PreprocHideset;
 
+// NOTE(ljre): Tokens that don't come straight from a file (e.g. results of macro expansion). The token
+//             reader walks these before going back to the file's C_PreprocTokenArray.
 struct C_PreprocTokenList typedef C_PreprocTokenList;
 struct C_PreprocTokenList
 {
 	C_PreprocTokenList* next;
 	C_PreprocHideset* hideset;
 	
-	C_SourceLocation* included_from;
-	C_SourceLocation* expanded_from;
+	C_SourceLoc loc;
 	
 	C_PreprocToken tok;
 };
@@ -242,7 +318,6 @@ enum C_LoadedFileFlags
 {
 	C_LoadedFileFlags_Null = 0,
 	
-	C_LoadedFileFlags_PragmaOnce = 1,
 	C_LoadedFileFlags_SystemFile = 2,
 	C_LoadedFileFlags_RelativeInclude = 4,
 }
@@ -258,10 +333,79 @@ struct C_LoadedFile
 	String contents;
 	
 	// NOTE(ljre): Non-null if file could be tokenized
-	C_PreprocTokenList* tokens;
+	C_PreprocTokenArray* tokens;
+	
+	// NOTE(ljre): If the whole file is inside '#ifndef X' ... '#endif', this is X. Otherwise 0.
+	C_SymbolId include_guard;
+	
+	// NOTE(ljre): See OS_FileInfo. Both are 0 if they couldn't be queried, in which case the file is
+	//             only the same as itself.
+	uint64 device;
+	uint64 inode;
+	
+	// NOTE(ljre): Built and published with a CAS by whoever needs it first. See C_GetLineIndex.
+	C_LineIndex* volatile line_index;
 }
 typedef C_LoadedFile;
 
+// NOTE(ljre): Process-wide cache of loaded files, shared by every TU on every thread. Entries are
+//             immutable once published, so a lookup that hits is just a few acquire loads. A miss loads
+//             and tokenizes the file into the worker's 'cache_arena' and tries to publish it with a CAS;
+//             if another thread won the race for the same path, ours is thrown away.
+//
+//             There's no resizing: when the table gets too full, files are just not cached anymore.
+//
+//             'id_slots' indexes the same files by (device, inode), so a file reached through another
+//             path (a symlink, '..', a different include dir) shares the contents and tokens of the first
+//             one instead of being read and tokenized again.
+struct C_FileCache
+{
+	uint32 log2cap;
+	volatile uint32 count;
+	volatile uint32 id_count;
+	
+	C_LoadedFile* volatile* slots;
+	C_LoadedFile* volatile* id_slots;
+}
+typedef C_FileCache;
+
+// NOTE(ljre): Where '#include <name>' resolved to when searching the include dirs. 'file' is NULL if it
+//             wasn't found in any of them.
+struct C_IncludeEntry
+{
+	uint64 name_hash;
+	String name;
+	C_LoadedFile* file;
+}
+typedef C_IncludeEntry;
+
+// NOTE(ljre): Hashes of the (ASCII lowercase) names of every entry in a directory, so we know a file is
+//             not there without asking the file system. Different names might have the same hash, which
+//             is fine: it just means we try to open a file that doesn't exist.
+struct C_DirListing
+{
+	uint64 path_hash;
+	String path;
+	
+	uint32 log2cap;
+	uint64* name_hashes; // NOTE(ljre): 0 means empty slot
+}
+typedef C_DirListing;
+
+// NOTE(ljre): Process-wide caches for resolving #include's. They work like C_FileCache: lock-free, never
+//             resized, and things just stop being cached when they get too full. The include dirs are
+//             the same for the whole run, so entries never get stale.
+struct C_IncludeCache
+{
+	uint32 log2cap;
+	volatile uint32 entry_count;
+	volatile uint32 dir_count;
+	
+	C_IncludeEntry* volatile* entries;
+	C_DirListing* volatile* dirs;
+}
+typedef C_IncludeCache;
+
 enum C_MacroInstKind
 {
 	C_MacroInstKind_Null = 0,
@@ -325,13 +469,17 @@ typedef C_MacroInst;
 struct C_Macro
 {
 	String name;
+	C_SymbolId symbol;
 	C_LoadedFile* file;
-	C_SourceLocation* definition_loc;
+	// NOTE(ljre): 0 for predefined macros, since they come from another TU's C_LocTable.
+	C_SourceLoc definition_loc;
 	
-	bool is_defined;
 	bool is_func_like;
 	bool has_va_args;
 	uint8 builtin_id;
+	// NOTE(ljre): Object-like and with no identifiers in 'replacement', so rescanning it can't expand
+	//             anything and it can be written straight to the output.
+	bool is_plain;
 	
 	uint32 replacement_count;
 	int32 param_count;
@@ -342,26 +490,101 @@ struct C_Macro
 }
 typedef C_Macro;
 
+// NOTE(ljre): Open addressing map from symbol to macro, in the style of SwissTable. 'ctrl' has one byte
+//             per slot: 0x80 if it's empty, 0xFE if its macro was #undef'd (a tombstone), or the low 7 bits
+//             of the symbol's hash otherwise. Lookups compare 16 control bytes at a time, and only look at
+//             'slots' when one matches.
+struct C_MacroTable
+{
+	uint32 log2cap;
+	uint32 count;
+	uint32 deleted;
+	
+	uint8* ctrl;
+	C_Macro** slots;
+}
+typedef C_MacroTable;
+
+// NOTE(ljre): Every macro defined before the main file starts (builtins, then the predefined macros in
+//             C_CompilerOptions), which are the same for every TU. They're parsed once from a synthetic
+//             '<command line>' file, and each TU just copies them into its hashmap in bulk.
+struct C_PredefinedMacros
+{
+	C_LoadedFile* file;
+	
+	uint32 count;
+	const C_Macro* macros;
+}
+typedef C_PredefinedMacros;
+
 //~ NOTE(ljre): Source location
-struct C_SourceLocation
+//
+// A C_SourceLoc is a 32-bit handle into the TU's C_LocTable, in the style of clang's SourceLocation. 0
+// is no location at all.
+//
+// With the high bit clear, it's a file location: every time a file is entered (by #include or as the
+// main file) it takes a range of 'contents.size + 1' locations, and a token in it is at 'base + offset
+// of the token'. With the high bit set, the low bits index 'expansions', and it's the location of every
+// token that came out of that macro expansion.
+//
+// Line and column are not stored anywhere. They're computed from the file's C_LineIndex only when
+// someone needs them, like the -E writer or a diagnostic.
+enum { C_SOURCE_LOC_EXPANSION_BIT = 0x80000000u };
+
+struct C_LocFile
 {
-	C_SourceLocation* included_from;
-	C_SourceLocation* expanded_from;
-	String filepath;
-	uint32 leading_spaces;
-	uint32 line, col;
+	C_LoadedFile* file;
+	C_SourceLoc included_from;
+	uint32 base;
+}
+typedef C_LocFile;
+
+struct C_LocExpansion
+{
+	C_SourceLoc expanded_from;
+	C_SymbolId macro;
+}
+typedef C_LocExpansion;
+
+// NOTE(ljre): 'expansions' is the only thing in the TU's 'loc_arena', so it grows in place. 'files' is
+//             short and is copied to a bigger array in the 'tree_arena' when full, since it's read after
+//             the preprocessor is done. Old arrays stay around and entries never change, so a reader on
+//             another thread only needs to load 'file_count' before 'files'.
+struct C_LocTable
+{
+	uint32 next_base;
+	
+	uint32 file_cap;
+	volatile uint32 file_count;
+	C_LocFile* volatile files;
+	
+	uint32 expansion_count;
+	C_LocExpansion* expansions;
+}
+typedef C_LocTable;
+
+// NOTE(ljre): Offset of the first byte of each line of a file, built the first time it's needed. A
+//             line and column is a binary search in here.
+struct C_LineIndex
+{
+	uint32 count;
+	uint32 starts[];
 };
 
 //~ NOTE(ljre): Parser tokens
+// NOTE(ljre): The spelling is pushed right after its size (an uint32), so the size doesn't need to take
+//             space in here. See C_TokenAsString.
 struct C_Token
 {
-	C_TokenKind kind;
-	uint32 str_size;
+	uint8 kind;
+	uint16 leading_spaces;
+	C_SourceLoc loc;
 	const uint8* str_data;
-	C_SourceLocation* loc;
 }
 typedef C_Token;
 
+static_assert(sizeof(C_Token) == 16);
+
 struct C_TokenStream
 {
 	uint32 size;
@@ -369,6 +592,18 @@ struct C_TokenStream
 }
 typedef C_TokenStream;
 
+// NOTE(ljre): Lets another thread read the output of the preprocessor while it's still being produced.
+//             Tokens before 'published' won't change anymore. 'sequence' is bumped (and waited on) every
+//             time 'published' or 'done' are updated.
+struct C_OutputPipe
+{
+	alignas(64) volatile uint32 sequence;
+	volatile uint32 published;
+	volatile uint32 done;
+	C_Token* volatile tokens;
+}
+typedef C_OutputPipe;
+
 //~ NOTE(ljre): Warnings and errors
 enum C_Warning
 {
@@ -380,6 +615,57 @@ enum C_Warning
 }
 typedef C_Warning;
 
+// NOTE(ljre): Every message the compiler can report. A message is shown as a warning if it has a
+//             C_Warning (which can be disabled), and as an error otherwise. Each '%S' in it is replaced by
+//             the next argument of the diagnostic.
+#define C_GEN_DIAGNOSTIC_TABLE(X) \
+X(PpExpectedMacroName, Null, "expected identifier in macro definition.") \
+X(PpExpectedMacroParam, Null, "expected a macro parameter.") \
+X(PpExpectedUndefName, Null, "expected identifier after #undef directive.") \
+X(PpUnterminatedIncludeName, Null, "unexpected end-of-line in include file name.") \
+X(PpCouldNotInclude, Null, "could not include '%S'.") \
+X(PpBadExpression, Null, "%S in preprocessor expression.") \
+X(PpExpectedDefinedName, Null, "expected identifier after 'defined'.") \
+X(PpExpectedDefinedParen, Null, "expected ')' after 'defined'.") \
+X(PpExpectedIfdefName, Null, "expected identifier after #ifdef or #ifndef.") \
+X(PpElseWithoutIf, Null, "#%S without #if.") \
+X(PpElseAfterElse, Null, "#%S after #else.") \
+X(PpEndifWithoutIf, Null, "#endif without #if.") \
+X(PpUnterminatedPragmaOperator, Null, "unterminated '%S'.") \
+X(PpBadPragmaOperator, Null, "_Pragma takes a parenthesized string literal.") \
+X(PpUnknownDirective, Null, "unknown preprocessor directive '%S'.") \
+X(PpUnterminatedConditional, Null, "unterminated conditional directive in '%S'.") \
+X(PpErrorDirective, Null, "#error %S") \
+X(PpWarningDirective, WarningDirective, "#warning %S") \
+X(BadPredefinedMacros, Null, "could not tokenize the predefined macros.") \
+X(CouldNotLoadInput, Null, "could not load input file '%S'.") \
+X(CouldNotWriteOutput, Null, "could not write to '%S': %S") \
+
+enum C_DiagnosticKind
+{
+	C_DiagnosticKind_Null = 0,
+	
+#define X(name, warning, message) C_DiagnosticKind_##name,
+	C_GEN_DIAGNOSTIC_TABLE(X)
+#undef X
+	
+	C_DiagnosticKind__Count,
+}
+typedef C_DiagnosticKind;
+
+enum { C_DIAGNOSTIC_MAX_ARGS = 2 };
+
+// NOTE(ljre): What's recorded while compiling. It's only formatted when every diagnostic of the TU is
+//             written at once, see C_EmitDiagnostics. Arguments are copied to the TU's 'tree_arena'.
+struct C_Diagnostic
+{
+	uint16 kind;
+	uint16 arg_count;
+	C_SourceLoc loc;
+	String args[C_DIAGNOSTIC_MAX_ARGS];
+}
+typedef C_Diagnostic;
+
 struct C_Error typedef C_Error;
 struct C_Error
 {
@@ -388,7 +674,7 @@ struct C_Error
 	
 	C_Warning warning;
 	String what;
-	const C_SourceLocation* location;
+	C_SourceLoc location;
 	uint32 focus_len, focus_point;
 };
 
@@ -438,14 +724,23 @@ typedef C_Abi;
 
 struct C_CompilerOptions
 {
+	// NOTE(ljre): A set bit disables that warning. See C_IsWarningEnabled.
 	uint64 warnings[(C_Warning__Count + 63) / 64];
 	
 	const String* include_dirs;
 	uintsize include_dirs_count;
 	
+	// NOTE(ljre): Each one is what would follow '#define', e.g. "NAME 1" or "F(x) (x)".
 	const String* predefined_macros;
 	uintsize predefined_macros_count;
 	
+	// NOTE(ljre): Names to #undef, after every predefined macro was defined.
+	const String* undefined_macros;
+	uintsize undefined_macros_count;
+	
+	// NOTE(ljre): Where to keep tokenized system headers between runs. Disabled if empty.
+	String token_cache_dir;
+	
 	C_Abi abi;
 }
 typedef C_CompilerOptions;
@@ -459,21 +754,34 @@ struct C_TuContext
 	Arena* stage_arena;
 	Arena* scratch_arena;
 	
+	// NOTE(ljre): Owned by the worker thread and never cleared. Data in here may be referenced by other
+	//             TUs (and other threads) through the 'file_cache'.
+	Arena* cache_arena;
+	C_FileCache* file_cache;
+	C_IncludeCache* include_cache;
+	
+	// NOTE(ljre): Same as 'cache_arena', but only for symbols. Files in the 'cache_arena' might be
+	//             thrown away after their tokens were interned, symbols never are.
+	Arena* symbol_arena;
+	C_SymbolTable* symbol_table;
+	
 	String main_file_name;
 	const C_CompilerOptions* options;
 	
-	C_HashMapChunk* macros_hashmap;
-	C_HashMapChunk* files_hashmap;
+	const C_PredefinedMacros* predefined_macros;
+	C_MacroTable macro_table;
 	
+	C_LocTable locs;
 	C_TokenStream preprocessed_source;
+	C_OutputPipe* output_pipe;
 	
 	uint32 error_count;
 	uint32 warning_count;
 	
-	C_Error* first_error;
-	C_Error* last_error;
-	C_Error* first_warning;
-	C_Error* last_warning;
+	// NOTE(ljre): In the 'tree_arena', copied to a bigger array when full. Diagnostics are rare.
+	uint32 diagnostic_count;
+	uint32 diagnostic_cap;
+	C_Diagnostic* diagnostics;
 }
 typedef C_TuContext;
 
@@ -0,0 +1,447 @@
+//~ NOTE(ljre): Compilation driver
+//
+// Every worker thread owns a 'cache_arena', a 'symbol_arena' and a 'line_arena' which are never cleared
+// and hold whatever it put in the shared file cache, symbol table and files' line indices. The arenas a
+// translation unit is compiled in come from the driver's C_ArenaPool, and go back to it (cleared) once
+// the TU is done. Jobs are distributed evenly between the workers up-front, and a worker that runs out
+// of jobs steals half of the remaining jobs of some other worker.
+//
+// A worker's queue is a single [begin, end) range of job indices packed into an uint64, so both
+// popping (owner, from the front) and stealing (thief, from the back) are a single CAS. Since no job
+// is ever pushed after startup, a full pass over the workers that finds every queue empty means we're
+// done.
+
+struct C_DriverJob
+{
+	String input_path;
+	String output_path;
+}
+typedef C_DriverJob;
+
+struct C_Driver typedef C_Driver;
+
+// NOTE(ljre): Committed memory kept by each arena of a set when it goes back to the pool. Most TUs need
+//             far less than this, so they start with all of their memory already faulted in, while an
+//             outlier doesn't keep its peak committed for the rest of the run.
+enum { C_TU_ARENA_RETAIN_SIZE = 64 << 20 };
+
+enum C_TuArenasState
+{
+	C_TuArenasState_Null = 0, // NOTE(ljre): Not created yet
+	C_TuArenasState_Free,
+	C_TuArenasState_InUse,
+}
+typedef C_TuArenasState;
+
+struct C_TuArenas
+{
+	volatile uint32 state;
+	// NOTE(ljre): Sum of the arenas' committed memory when it was released.
+	volatile uint64 commited;
+	
+	union
+	{
+		struct
+		{
+			Arena* loc_arena;
+			Arena* array_arena;
+			Arena* tree_arena;
+			Arena* stage_arena;
+			Arena* scratch_arena;
+		};
+		
+		Arena* arenas[5];
+	};
+}
+typedef C_TuArenas;
+
+// NOTE(ljre): 'count' should be the number of workers. A set is only created when none is free, so
+//             there's rarely more sets than there are TUs being compiled at once.
+struct C_ArenaPool
+{
+	uint32 count;
+	C_TuArenas* sets;
+}
+typedef C_ArenaPool;
+
+struct C_Worker
+{
+	// NOTE(ljre): Packed [begin, end) range of job indices; begin in the low 32 bits.
+	alignas(64) volatile uint64 queue;
+	
+	C_Driver* driver;
+	uint32 index;
+	bool thread_started;
+	OS_Thread thread;
+	
+	Arena* cache_arena;
+	Arena* symbol_arena;
+	Arena* line_arena;
+}
+typedef C_Worker;
+
+struct C_Driver
+{
+	const C_CompilerOptions* options;
+	bool verbose;
+	
+	C_FileCache* file_cache;
+	C_IncludeCache* include_cache;
+	C_SymbolTable* symbol_table;
+	C_PredefinedMacros* predefined_macros;
+	C_ArenaPool arena_pool;
+	
+	uint32 job_count;
+	const C_DriverJob* jobs;
+	
+	uint32 worker_count;
+	C_Worker* workers;
+	
+	// NOTE(ljre): Write each TU's output from a second thread while it's still being preprocessed.
+	bool pipeline_output;
+	
+	volatile uint32 failed_count;
+};
+
+//~ NOTE(ljre): Arena pool
+// NOTE(ljre): Takes the free set with the most memory committed, since that's the one that needs the
+//             least page faults, or creates a new one if there's none.
+static C_TuArenas*
+C_AcquireTuArenas(C_ArenaPool* pool)
+{
+	for (;;)
+	{
+		C_TuArenas* best = NULL;
+		uint64 best_commited = 0;
+		C_TuArenas* uncreated = NULL;
+		
+		for (uint32 i = 0; i < pool->count; ++i)
+		{
+			C_TuArenas* set = &pool->sets[i];
+			uint32 state = Atomic_Load32(&set->state);
+			
+			if (state == C_TuArenasState_Free)
+			{
+				uint64 commited = Atomic_Load64(&set->commited);
+				
+				if (!best || commited > best_commited)
+				{
+					best = set;
+					best_commited = commited;
+				}
+			}
+			else if (state == C_TuArenasState_Null && !uncreated)
+				uncreated = set;
+		}
+		
+		if (best && Atomic_CompareExchange32(&best->state, C_TuArenasState_Free, C_TuArenasState_InUse) == C_TuArenasState_Free)
+			return best;
+		
+		if (!best && uncreated && Atomic_CompareExchange32(&uncreated->state, C_TuArenasState_Null, C_TuArenasState_InUse) == C_TuArenasState_Null)
+		{
+			for (uint32 i = 0; i < ArrayLength(uncreated->arenas); ++i)
+				uncreated->arenas[i] = Arena_Create(512ull << 20, 8ull << 20);
+			
+			return uncreated;
+		}
+		
+		// NOTE(ljre): Lost a race, or every set is taken. There are as many sets as workers, so some set
+		//             is about to be released.
+		Atomic_Pause();
+	}
+}
+
+static void
+C_ReleaseTuArenas(C_ArenaPool* pool, C_TuArenas* set)
+{
+	uint64 commited = 0;
+	
+	for (uint32 i = 0; i < ArrayLength(set->arenas); ++i)
+	{
+		Arena_Clear(set->arenas[i]);
+		Arena_Decommit(set->arenas[i], C_TU_ARENA_RETAIN_SIZE);
+		commited += set->arenas[i]->commited;
+	}
+	
+	Atomic_Store64(&set->commited, commited);
+	Atomic_Store32(&set->state, C_TuArenasState_Free);
+}
+
+//~ NOTE(ljre): Workers
+static inline uint64
+C_PackJobRange(uint32 begin, uint32 end)
+{ return (uint64)begin | (uint64)end << 32; }
+
+static bool
+C_WorkerPopJob(C_Worker* worker, uint32* out_index)
+{
+	uint64 queue = Atomic_Load64(&worker->queue);
+	
+	for (;;)
+	{
+		uint32 begin = (uint32)queue;
+		uint32 end = (uint32)(queue >> 32);
+		
+		if (begin >= end)
+			return false;
+		
+		uint64 previous = Atomic_CompareExchange64(&worker->queue, queue, C_PackJobRange(begin+1, end));
+		if (previous == queue)
+		{
+			*out_index = begin;
+			return true;
+		}
+		
+		queue = previous;
+	}
+}
+
+static bool
+C_WorkerStealJobs(C_Worker* thief, uint32* out_index)
+{
+	C_Driver* driver = thief->driver;
+	
+	for (uint32 i = 1; i < driver->worker_count; ++i)
+	{
+		C_Worker* victim = &driver->workers[(thief->index + i) % driver->worker_count];
+		uint64 queue = Atomic_Load64(&victim->queue);
+		
+		for (;;)
+		{
+			uint32 begin = (uint32)queue;
+			uint32 end = (uint32)(queue >> 32);
+			
+			if (begin >= end)
+				break;
+			
+			uint32 to_steal = (end - begin + 1) / 2;
+			uint32 new_end = end - to_steal;
+			
+			uint64 previous = Atomic_CompareExchange64(&victim->queue, queue, C_PackJobRange(begin, new_end));
+			if (previous == queue)
+			{
+				// NOTE(ljre): Keep the first stolen job and queue up the rest. Our queue is empty, so
+				//             nobody else can be racing with this store.
+				*out_index = new_end;
+				Atomic_Store64(&thief->queue, C_PackJobRange(new_end+1, end));
+				
+				return true;
+			}
+			
+			queue = previous;
+		}
+	}
+	
+	return false;
+}
+
+struct C_GnuWriterThread
+{
+	OS_Thread thread;
+	C_GnuWriter* writer;
+	C_OutputPipe pipe;
+}
+typedef C_GnuWriterThread;
+
+static int32
+C_GnuWriterThreadProc(void* user_data)
+{
+	C_GnuWriterThread* writer_thread = user_data;
+	C_GnuWriterFollowPipe(writer_thread->writer, &writer_thread->pipe);
+	
+	return 0;
+}
+
+static bool
+C_CompileJob(C_Worker* worker, const C_DriverJob* job)
+{
+	C_Driver* driver = worker->driver;
+	C_TuArenas* arenas = C_AcquireTuArenas(&driver->arena_pool);
+	
+	C_TuContext tu = {
+		.loc_arena = arenas->loc_arena,
+		.array_arena = arenas->array_arena,
+		.tree_arena = arenas->tree_arena,
+		.stage_arena = arenas->stage_arena,
+		.scratch_arena = arenas->scratch_arena,
+		
+		.cache_arena = worker->cache_arena,
+		.file_cache = driver->file_cache,
+		.include_cache = driver->include_cache,
+		.symbol_arena = worker->symbol_arena,
+		.symbol_table = driver->symbol_table,
+		
+		.main_file_name = job->input_path,
+		.options = driver->options,
+		.predefined_macros = driver->predefined_macros,
+	};
+	
+	//- preprocess
+	C_GnuWriter* writer = Arena_PushStruct(tu.scratch_arena, C_GnuWriter);
+	writer->locs = &tu.locs;
+	writer->line_arena = worker->line_arena;
+	bool is_open = true;
+	
+	if (String_Equals(job->output_path, Str("-")))
+		writer->file = OS_GetStdout();
+	else
+		is_open = OS_OpenFileForWriting(job->output_path, &writer->file, tu.scratch_arena, &writer->err);
+	
+	writer->ok = is_open;
+	C_GnuWriterThread writer_thread = {
+		.writer = writer,
+	};
+	
+	bool is_pipelined = false;
+	
+	if (is_open && driver->pipeline_output)
+	{
+		tu.output_pipe = &writer_thread.pipe;
+		is_pipelined = OS_CreateThread(&writer_thread.thread, C_GnuWriterThreadProc, &writer_thread, NULL);
+		
+		if (!is_pipelined)
+			tu.output_pipe = NULL;
+	}
+	
+	C_Preprocess(&tu);
+	
+	if (is_pipelined)
+		OS_JoinThread(&writer_thread.thread);
+	else if (is_open)
+		C_GnuWriterWriteTokens(writer, tu.preprocessed_source.tokens, tu.preprocessed_source.size);
+	
+	if (is_open)
+	{
+		C_GnuWriterFlush(writer);
+		OS_CloseFile(writer->file);
+	}
+	
+	if (!writer->ok)
+		C_PushDiagnostic(&tu, C_DiagnosticKind_CouldNotWriteOutput, 0, 2, job->output_path, writer->err.why);
+	
+	//if (tu.error_count == 0)
+	//C_Parse(&tu);
+	
+	C_EmitDiagnostics(&tu);
+	
+	if (driver->verbose)
+	{
+		C_LogFmt(tu.scratch_arena,
+			"[MEMORY USAGE] %S\n"
+			"\tloc_arena:     %z of %z\n"
+			"\tarray_arena:   %z of %z\n"
+			"\ttree_arena:    %z of %z\n"
+			"\tstage_arena:   %z of %z\n"
+			"\tscratch_arena: %z of %z\n"
+			"\tcache_arena:   %z of %z\n"
+			"\tsymbol_arena:  %z of %z\n"
+			"\tline_arena:    %z of %z\n",
+			job->input_path,
+			tu.loc_arena->offset, tu.loc_arena->commited,
+			tu.array_arena->offset, tu.array_arena->commited,
+			tu.tree_arena->offset, tu.tree_arena->commited,
+			tu.stage_arena->offset, tu.stage_arena->commited,
+			tu.scratch_arena->offset, tu.scratch_arena->commited,
+			tu.cache_arena->offset, tu.cache_arena->commited,
+			tu.symbol_arena->offset, tu.symbol_arena->commited,
+			worker->line_arena->offset, worker->line_arena->commited);
+	}
+	
+	C_ReleaseTuArenas(&driver->arena_pool, arenas);
+	
+	return tu.error_count == 0;
+}
+
+static int32
+C_WorkerProc(void* user_data)
+{
+	C_Worker* worker = user_data;
+	C_Driver* driver = worker->driver;
+	uint32 index;
+	
+	for (;;)
+	{
+		if (!C_WorkerPopJob(worker, &index) && !C_WorkerStealJobs(worker, &index))
+			break;
+		
+		if (!C_CompileJob(worker, &driver->jobs[index]))
+			Atomic_FetchAdd32(&driver->failed_count, 1);
+	}
+	
+	return 0;
+}
+
+// NOTE(ljre): Runs every job in the driver and returns how many of them failed. 'workers' should have
+//             'driver->worker_count' elements. Worker 0 runs in the calling thread.
+static uint32
+C_RunDriver(C_Driver* driver)
+{
+	Assert(driver->worker_count > 0);
+	
+	uint32 worker_count = driver->worker_count;
+	uint32 jobs_per_worker = driver->job_count / worker_count;
+	uint32 extra_jobs = driver->job_count % worker_count;
+	uint32 next_job = 0;
+	
+	for (uint32 i = 0; i < worker_count; ++i)
+	{
+		C_Worker* worker = &driver->workers[i];
+		uint32 count = jobs_per_worker + (i < extra_jobs);
+		
+		worker->driver = driver;
+		worker->index = i;
+		worker->queue = C_PackJobRange(next_job, next_job + count);
+		next_job += count;
+		
+		worker->cache_arena = Arena_Create(4ull << 30, 8ull << 20);
+		worker->symbol_arena = Arena_Create(1ull << 30, 1ull << 20);
+		worker->line_arena = Arena_Create(1ull << 30, 1ull << 20);
+	}
+	
+	// NOTE(ljre): The predefined macros are the same for every TU, so they're parsed only once, into
+	//             the first worker's cache arena. Everything else only lives until the diagnostics are
+	//             written, and has to stay out of the stage arena, where macro definitions are built.
+	C_Worker* first = &driver->workers[0];
+	C_TuArenas* predefined_arenas = C_AcquireTuArenas(&driver->arena_pool);
+	C_TuContext predefined_tu = {
+		.loc_arena = predefined_arenas->loc_arena,
+		.array_arena = predefined_arenas->array_arena,
+		.tree_arena = predefined_arenas->tree_arena,
+		.stage_arena = first->cache_arena,
+		.scratch_arena = predefined_arenas->scratch_arena,
+		
+		.cache_arena = first->cache_arena,
+		.file_cache = driver->file_cache,
+		.include_cache = driver->include_cache,
+		.symbol_arena = first->symbol_arena,
+		.symbol_table = driver->symbol_table,
+		
+		.main_file_name = Str("<command line>"),
+		.options = driver->options,
+	};
+	
+	driver->predefined_macros = C_CreatePredefinedMacros(&predefined_tu);
+	C_EmitDiagnostics(&predefined_tu);
+	C_ReleaseTuArenas(&driver->arena_pool, predefined_arenas);
+	
+	// NOTE(ljre): Like GCC, a bad -D or -U still lets every input be preprocessed, but the run fails.
+	if (predefined_tu.error_count > 0)
+		Atomic_FetchAdd32(&driver->failed_count, 1);
+	
+	// NOTE(ljre): If a thread can't be created, its jobs are simply stolen by the others.
+	for (uint32 i = 1; i < worker_count; ++i)
+	{
+		C_Worker* worker = &driver->workers[i];
+		worker->thread_started = OS_CreateThread(&worker->thread, C_WorkerProc, worker, NULL);
+	}
+	
+	C_WorkerProc(&driver->workers[0]);
+	
+	for (uint32 i = 1; i < worker_count; ++i)
+	{
+		if (driver->workers[i].thread_started)
+			OS_JoinThread(&driver->workers[i].thread);
+	}
+	
+	return driver->failed_count;
+}
@@ -1,30 +1,155 @@
-static C_Error*
-C_PushErrorOrWarning(C_TuContext* tu, String what, const C_SourceLocation* loc, C_Warning warning)
+//~ NOTE(ljre): Diagnostics
+//
+// Diagnostics are recorded as C_Diagnostic (kind, location and arguments) and only formatted at the
+// end of the TU, when they're sorted by location and written to stderr in a single call. A disabled
+// warning is dropped before anything is recorded.
+
+struct C_DiagnosticInfo
+{
+	C_Warning warning;
+	String message;
+}
+typedef C_DiagnosticInfo;
+
+static const C_DiagnosticInfo C_diagnostic_info[C_DiagnosticKind__Count] = {
+#define X(name, warning, message) [C_DiagnosticKind_##name] = { C_Warning_##warning, StrInit(message) },
+	C_GEN_DIAGNOSTIC_TABLE(X)
+#undef X
+};
+
+static inline bool
+C_IsWarningEnabled(const C_CompilerOptions* options, C_Warning warning)
+{ return !(options->warnings[warning / 64] & (1ull << (warning % 64))); }
+
+// NOTE(ljre): 'args' are 'arg_count' Strings.
+static void
+C_PushDiagnosticV(C_TuContext* tu, C_DiagnosticKind kind, C_SourceLoc loc, uint32 arg_count, va_list args)
+{
+	Assert(kind > 0 && kind < C_DiagnosticKind__Count);
+	Assert(arg_count <= C_DIAGNOSTIC_MAX_ARGS);
+	
+	C_Warning warning = C_diagnostic_info[kind].warning;
+	
+	if (warning && !C_IsWarningEnabled(tu->options, warning))
+		return;
+	
+	if (tu->diagnostic_count >= tu->diagnostic_cap)
+	{
+		uint32 new_cap = tu->diagnostic_cap ? tu->diagnostic_cap * 2 : 16;
+		C_Diagnostic* new_diagnostics = Arena_PushArray(tu->tree_arena, C_Diagnostic, new_cap);
+		
+		if (tu->diagnostic_count > 0)
+			Mem_Copy(new_diagnostics, tu->diagnostics, sizeof(C_Diagnostic) * tu->diagnostic_count);
+		
+		tu->diagnostics = new_diagnostics;
+		tu->diagnostic_cap = new_cap;
+	}
+	
+	C_Diagnostic* diag = &tu->diagnostics[tu->diagnostic_count++];
+	diag->kind = (uint16)kind;
+	diag->arg_count = (uint16)arg_count;
+	diag->loc = loc;
+	
+	for (uint32 i = 0; i < arg_count; ++i)
+		diag->args[i] = Arena_PushString(tu->tree_arena, va_arg(args, String));
+	
+	if (warning)
+		++tu->warning_count;
+	else
+		++tu->error_count;
+}
+
+static void
+C_PushDiagnostic(C_TuContext* tu, C_DiagnosticKind kind, C_SourceLoc loc, uint32 arg_count, ...)
+{
+	va_list args;
+	va_start(args, arg_count);
+	C_PushDiagnosticV(tu, kind, loc, arg_count, args);
+	va_end(args);
+}
+
+static void
+C_PushFormattedDiagnostic(Arena* arena, C_TuContext* tu, const C_Diagnostic* diag)
 {
-	C_Error* err;
+	const C_DiagnosticInfo* info = &C_diagnostic_info[diag->kind];
+	C_SourceLoc loc = C_GetFileLoc(&tu->locs, diag->loc);
+	const C_LocFile* loc_file = C_FindLocFile(&tu->locs, loc);
 	
-	if (!tu->first_error)
-		err = tu->first_error = tu->last_error = Arena_PushStruct(tu->tree_arena, C_Error);
+	if (loc_file)
+	{
+		// NOTE(ljre): The preprocessor is done by now, so its 'cache_arena' is free to use.
+		const C_LineIndex* lines = C_GetLineIndex(loc_file->file, tu->cache_arena);
+		uint32 line, col;
+		C_LineColumnFromOffset(lines, loc - loc_file->base, &line, &col);
+		
+		Arena_Printf(arena, "%S:%u:%u: ", loc_file->file->path, line, col);
+	}
 	else
-		err = tu->last_error = tu->last_error->next = Arena_PushStruct(tu->tree_arena, C_Error);
+		Arena_Printf(arena, "%S: ", tu->main_file_name);
 	
-	err->warning = warning;
-	err->what = what;
-	err->location = loc;
+	Arena_PushString(arena, info->warning ? Str("warning: ") : Str("error: "));
 	
-	return err;
+	String message = info->message;
+	uint32 next_arg = 0;
+	
+	for (uintsize i = 0; i < message.size; ++i)
+	{
+		if (message.data[i] == '%' && i+1 < message.size && message.data[i+1] == 'S')
+		{
+			Assert(next_arg < diag->arg_count);
+			Arena_PushString(arena, diag->args[next_arg++]);
+			++i;
+		}
+		else
+			Arena_PushData(arena, &message.data[i]);
+	}
+	
+	Arena_PushString(arena, Str("\n"));
 }
 
+// NOTE(ljre): Writes every diagnostic of the TU to stderr, sorted by where they happened.
 static void
-C_PrintAllErrorsAndWarnings(C_TuContext* tu)
+C_EmitDiagnostics(C_TuContext* tu)
 {
+	if (tu->diagnostic_count == 0)
+		return;
+	
 	for Arena_TempScope(tu->scratch_arena)
 	{
+		uint32 count = tu->diagnostic_count;
+		C_Diagnostic* sorted = Arena_PushArrayData(tu->scratch_arena, C_Diagnostic, tu->diagnostics, count);
+		C_SourceLoc* keys = Arena_PushArray(tu->scratch_arena, C_SourceLoc, count);
+		
+		for (uint32 i = 0; i < count; ++i)
+			keys[i] = C_GetFileLoc(&tu->locs, sorted[i].loc);
+		
+		// NOTE(ljre): Diagnostics are recorded in roughly the order of their locations already, so an
+		//             insertion sort is mostly a linear pass. It's also stable, which keeps diagnostics at
+		//             the same place in the order they were reported.
+		for (uint32 i = 1; i < count; ++i)
+		{
+			C_Diagnostic diag = sorted[i];
+			C_SourceLoc key = keys[i];
+			uint32 j = i;
+			
+			for (; j > 0 && keys[j-1] > key; --j)
+			{
+				sorted[j] = sorted[j-1];
+				keys[j] = keys[j-1];
+			}
+			
+			sorted[j] = diag;
+			keys[j] = key;
+		}
+		
 		uint8* begin = Arena_End(tu->scratch_arena);
 		
-		// TODO
+		for (uint32 i = 0; i < count; ++i)
+			C_PushFormattedDiagnostic(tu->scratch_arena, tu, &sorted[i]);
 		
-		String final_str = StrMake((uint8*)Arena_End(tu->scratch_arena) - begin, begin);
-		C_Log(tu->scratch_arena, final_str);
+		uint8* end = Arena_End(tu->scratch_arena);
+		C_Log(tu->scratch_arena, StrRange(begin, end));
 	}
+	
+	tu->diagnostic_count = 0;
 }
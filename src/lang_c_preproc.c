@@ -1,24 +1,80 @@
+// NOTE(ljre): Reads tokens from 'list' until it's NULL, then from 'array' starting at 'index'. Macro
+//             expansions are spliced in by pushing tokens to the front of 'list', so the file's tokens
+//             are never copied.
 struct C_PpTokenReader
 {
 	C_PreprocTokenList* list;
+	const C_PreprocTokenArray* array;
+	uint32 index;
+	
 	C_PreprocToken tok;
 }
 typedef C_PpTokenReader;
 
+struct C_PpHidesetMemo
+{
+	const C_PreprocHideset* set;
+	C_SymbolId symbol;
+	C_PreprocHideset* result;
+}
+typedef C_PpHidesetMemo;
+
+// NOTE(ljre): An #if, #ifdef or #ifndef whose #endif wasn't reached yet.
+struct C_PpCondition typedef C_PpCondition;
+struct C_PpCondition
+{
+	C_PpCondition* next;
+	
+	bool taken; // NOTE(ljre): One of its groups was (or is being) included
+	bool seen_else;
+};
+
 struct C_PpContext
 {
 	C_TuContext* tu;
 	C_TokenStream output;
 	
 	C_LoadedFile* current_file;
-	C_SourceLocation* included_from;
+	C_SourceLoc included_from;
+	// NOTE(ljre): Location of the current file's first byte. See C_PpTokenLoc.
+	uint32 file_base;
 	
 	uint32 last_loc_index;
 	
+	// NOTE(ljre): Every distinct hideset of this TU, in the stage arena. See C_PpHidesetInsert.
+	uint32 hidesets_log2cap;
+	uint32 hidesets_count;
+	C_PreprocHideset** hidesets;
+	C_PpHidesetMemo* hideset_memo;
+	
+	// NOTE(ljre): Index+1 into 'tu->locs.expansions' of every distinct expansion record, in the stage arena.
+	//             See C_PpPushLocExpansion.
+	uint32 expansion_slots_log2cap;
+	uint32* expansion_slots;
+	
+	// NOTE(ljre): Stack of open conditionals. 'file_conditions' is how it was when the current file began,
+	//             since conditionals can't span multiple files.
+	C_PpCondition* conditions;
+	C_PpCondition* file_conditions;
+	C_PpCondition* free_conditions;
+	
+	// NOTE(ljre): Files that went through '#pragma once' in this TU. It can't be a flag in C_LoadedFile,
+	//             since those are shared by every TU.
+	uint32 once_files_log2cap;
+	uint32 once_files_count;
+	C_LoadedFile** once_files;
+	
 	bool ok;
 }
 typedef C_PpContext;
 
+enum
+{
+	C_PP_HIDESET_MEMO_SIZE = 1024,
+	// NOTE(ljre): Waking up the reader of 'tu->output_pipe' takes a syscall, so don't do it for every token.
+	C_PP_OUTPUT_PUBLISH_BATCH = 1024,
+};
+
 enum C_PpBuiltinMacro
 {
 	C_PpBuiltinMacro_Null = 0,
@@ -28,33 +84,96 @@ enum C_PpBuiltinMacro
 }
 typedef C_PpBuiltinMacro;
 
-static void C_PpPreprocessFile(C_PpContext* pp, C_LoadedFile* file, C_SourceLocation* included_from);
+static void C_PpPreprocessFile(C_PpContext* pp, C_LoadedFile* file, C_SourceLoc included_from);
 static bool C_PpTryToExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, uint32* out_added_token_count);
 
+//~ NOTE(ljre): Token reader
+static inline C_PpTokenReader
+C_PpMakeTokenReader(C_PreprocTokenList* list, const C_PreprocTokenArray* array, uint32 index)
+{
+	C_PpTokenReader rd = { list, array, index };
+	
+	if (list)
+		rd.tok = list->tok;
+	else if (array && index < array->size)
+		rd.tok = C_GetPreprocToken(array, index);
+	
+	return rd;
+}
+
+// NOTE(ljre): Reloads 'rd->tok' after 'rd->list' was changed by someone else.
+static inline void
+C_PpSyncToken(C_PpTokenReader* rd)
+{
+	*rd = C_PpMakeTokenReader(rd->list, rd->array, rd->index);
+}
+
+static inline void
+C_PpNextToken(C_PpTokenReader* rd)
+{
+	if (rd->list)
+		rd->list = rd->list->next;
+	else if (rd->array && rd->index < rd->array->size)
+		++rd->index;
+	
+	C_PpSyncToken(rd);
+}
+
+static inline C_PreprocToken
+C_PpPeekToken(C_PpTokenReader* rd)
+{
+	C_PpTokenReader peek = *rd;
+	C_PpNextToken(&peek);
+	
+	return peek.tok;
+}
+
+// NOTE(ljre): Tokens that come straight from the file have no hideset.
+static inline C_PreprocHideset*
+C_PpTokenHideset(C_PpTokenReader* rd)
+{ return rd->list ? rd->list->hideset : NULL; }
+
+// NOTE(ljre): A token straight from the current file is located by its offset in it. Tokens that were
+//             made up on the spot (like the ones of a _Pragma string) have no location.
+static inline C_SourceLoc
+C_PpTokenLoc(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	if (rd->list)
+		return rd->list->loc;
+	if (rd->array && rd->array == pp->current_file->tokens && rd->index < rd->array->size)
+		return pp->file_base + rd->array->str_offsets[rd->index];
+	
+	return 0;
+}
+
+static C_PreprocTokenList**
+C_PpQueueToken(C_PreprocTokenList** ptoks, Arena* arena, const C_PreprocToken* token, C_PreprocHideset* hideset, C_SourceLoc loc)
+{
+	C_PreprocTokenList* item = Arena_PushStruct(arena, C_PreprocTokenList);
+	item->tok = *token;
+	item->next = *ptoks;
+	item->hideset = hideset;
+	item->loc = loc;
+	*ptoks = item;
+	
+	return &item->next;
+}
+
 //~ NOTE(ljre): Utils
+// NOTE(ljre): Reported at the token 'rd' is at, or nowhere if 'rd' is NULL. The variadic arguments are
+//             'arg_count' Strings, see C_PushDiagnostic.
 static void
-C_PpPushError(C_PpContext* pp, C_PpTokenReader* rd, const char* fmt, ...)
+C_PpPushDiagnostic(C_PpContext* pp, C_PpTokenReader* rd, C_DiagnosticKind kind, uint32 arg_count, ...)
 {
-	for Arena_TempScope(pp->tu->scratch_arena)
-	{
-		va_list args;
-		va_start(args, fmt);
-		String str = Arena_VPrintf(pp->tu->scratch_arena, fmt, args);
-		va_end(args);
-		
-		Arena_PushString(pp->tu->scratch_arena, Str("\n"));
-		str.size++;
-		
-		C_Log(pp->tu->scratch_arena, str);
-	}
+	va_list args;
+	va_start(args, arg_count);
+	C_PushDiagnosticV(pp->tu, kind, rd ? C_PpTokenLoc(pp, rd) : 0, arg_count, args);
+	va_end(args);
 }
 
-static String
-C_PpStringifyString(Arena* arena, String str)
+static void
+C_PpPushEscapedString(Arena* arena, String str)
 {
-	uint8* const begin = Arena_End(arena);
-	Arena_PushString(arena, Str("\""));
-	
 	for (int32 i = 0; i < str.size; ++i)
 	{
 		if (str.data[i] == '\\')
@@ -64,19 +183,27 @@ C_PpStringifyString(Arena* arena, String str)
 		else
 			Arena_PushData(arena, &str.data[i]);
 	}
+}
+
+static String
+C_PpStringifyString(Arena* arena, String str)
+{
+	uint8* const begin = Arena_End(arena);
 	
 	Arena_PushString(arena, Str("\""));
-	uint8* const end = Arena_End(arena);
+	C_PpPushEscapedString(arena, str);
+	Arena_PushString(arena, Str("\""));
 	
+	uint8* const end = Arena_End(arena);
 	return StrRange(begin, end);
 }
 
 static int32
-C_PpFindStringInArray(const String* array, uint32 size, String target)
+C_PpFindSymbolInArray(const C_SymbolId* array, uint32 size, C_SymbolId target)
 {
 	for (int32 i = 0; i < size; ++i)
 	{
-		if (String_Equals(target, array[i]))
+		if (target == array[i])
 			return i;
 	}
 	
@@ -93,14 +220,15 @@ C_PpUnstringify(Arena* arena, String str)
 	const uint8* str_head = str.data + 1;
 	const uint8* const str_end = str.data + str.size - 1;
 	
-	for (; str_head < str_end; ++str_head)
+	while (str_head < str_end)
 	{
 		uint32 value = 0;
 		
+		// NOTE(ljre): C_DecodeEscapeSequence already leaves 'str_head' after the whole sequence.
 		if (str_head[0] == '\\')
 			value = C_DecodeEscapeSequence(&str_head, str_end);
 		else
-			value = str_head[0];
+			value = *str_head++;
 		
 		uint8 truncated = (uint8)value;
 		Arena_PushData(arena, &truncated);
@@ -115,9 +243,12 @@ C_PpStringifyToken(Arena* arena, const C_PreprocToken* token)
 {
 	uint8* const begin = Arena_End(arena);
 	
+	// NOTE(ljre): A literal keeps its own quotes, only escaped.
 	switch (token->kind)
 	{
-		case C_TokenKind_StringLiteral: C_PpStringifyString(arena, token->as_string); break;
+		case C_TokenKind_StringLiteral:
+		case C_TokenKind_WideStringLiteral:
+		case C_TokenKind_CharLiteral: C_PpPushEscapedString(arena, token->as_string); break;
 		default: Arena_PushString(arena, token->as_string); break;
 	}
 	
@@ -126,16 +257,18 @@ C_PpStringifyToken(Arena* arena, const C_PreprocToken* token)
 }
 
 static String
-C_PpStringifyTokens(Arena* arena, C_PreprocTokenList* tokens, uint32 count)
+C_PpStringifyTokens(Arena* arena, C_PpTokenReader tokens, uint32 count)
 {
 	uint8* const begin = Arena_End(arena);
 	Arena_PushString(arena, Str("\""));
 	
-	C_PreprocTokenList* it = tokens;
-	while (count --> 0)
+	for (uint32 i = 0; i < count; ++i, C_PpNextToken(&tokens))
 	{
-		C_PpStringifyToken(arena, &it->tok);
-		it = it->next;
+		// NOTE(ljre): Any whitespace between tokens becomes a single space.
+		if (i > 0 && tokens.tok.leading_spaces > 0)
+			Arena_PushString(arena, Str(" "));
+		
+		C_PpStringifyToken(arena, &tokens.tok);
 	}
 	
 	Arena_PushString(arena, Str("\""));
@@ -144,59 +277,61 @@ C_PpStringifyTokens(Arena* arena, C_PreprocTokenList* tokens, uint32 count)
 	return StrRange(begin, end);
 }
 
+// NOTE(ljre): Pastes identifier##identifier and identifier##number without going through the lexer.
+//             Returns false if the result might not be a single identifier.
+static bool
+C_PpTryToPasteIdentifier(C_PpContext* pp, const C_PreprocToken* left, const C_PreprocToken* right, C_PreprocToken* out_tok)
+{
+	String l = left->as_string;
+	String r = right->as_string;
+	uint8 buffer[256];
+	
+	if (left->kind != C_TokenKind_Identifier || l.size + r.size > sizeof(buffer))
+		return false;
+	if (Char_SkipIdent(r.data, r.data + r.size) != r.data + r.size)
+		return false;
+	
+	Mem_Copy(buffer, l.data, l.size);
+	Mem_Copy(buffer + l.size, r.data, r.size);
+	
+	// NOTE(ljre): The interned name outlives the TU, so the result doesn't need a copy of its own.
+	C_Symbol* symbol = C_InternSymbolEntry(pp->tu->symbol_table, pp->tu->symbol_arena, StrMake(l.size + r.size, buffer));
+	
+	*out_tok = (C_PreprocToken) {
+		.kind = C_TokenKind_Identifier,
+		.leading_spaces = left->leading_spaces,
+		.symbol = symbol->id,
+		.as_string = symbol->name,
+	};
+	
+	return true;
+}
+
 static C_PreprocTokenList**
-C_PpConcatTokens(C_PpContext* pp, const C_PreprocToken* left, const C_PreprocToken* right, C_PreprocTokenList** out_tokens, C_PreprocHideset* hideset, C_SourceLocation* loc)
+C_PpConcatTokens(C_PpContext* pp, const C_PreprocToken* left, const C_PreprocToken* right, C_PreprocTokenList** out_tokens, C_PreprocHideset* hideset, C_SourceLoc loc)
 {
 	C_PreprocTokenList** head = out_tokens;
+	C_PreprocToken pasted;
+	
+	if (C_PpTryToPasteIdentifier(pp, left, right, &pasted))
+		return C_PpQueueToken(head, pp->tu->scratch_arena, &pasted, hideset, loc);
 	
 	uint8* const begin = Arena_End(pp->tu->stage_arena);
-	C_PpStringifyToken(pp->tu->stage_arena, left);
-	C_PpStringifyToken(pp->tu->stage_arena, right);
+	Arena_PushString(pp->tu->stage_arena, left->as_string);
+	Arena_PushString(pp->tu->stage_arena, right->as_string);
 	uint8* const end = Arena_End(pp->tu->stage_arena);
 	
-	C_PreprocTokenList* list = C_TokenizeForPreproc(pp->tu, pp->tu->scratch_arena, StrRange(begin, end), NULL);
-	*head = list;
+	C_PreprocTokenArray* array = C_TokenizeForPreproc(pp->tu, pp->tu->scratch_arena, StrRange(begin, end), NULL);
 	
-	for (;;)
+	for (uint32 i = 0; array && i < array->size; ++i)
 	{
-		list->hideset = hideset;
-		list->expanded_from = loc;
-		
-		if (!list->next)
-			break;
-		
-		list = list->next;
+		C_PreprocToken tok = C_GetPreprocToken(array, i);
+		head = C_PpQueueToken(head, pp->tu->scratch_arena, &tok, hideset, loc);
 	}
 	
-	head = &list->next;
 	return head;
 }
 
-//~ NOTE(ljre): Token reader
-static inline void
-C_PpNextToken(C_PpTokenReader* rd)
-{
-	if (!rd->list)
-		rd->tok = (C_PreprocToken) { 0 };
-	else
-	{
-		rd->list = rd->list->next;
-		
-		if (rd->list)
-			rd->tok = rd->list->tok;
-		else
-			rd->tok = (C_PreprocToken) { 0 };
-	}
-}
-
-static inline C_PreprocToken
-C_PpPeekToken(C_PpTokenReader* rd)
-{
-	if (rd->list && rd->list->next)
-		return rd->list->next->tok;
-	return (C_PreprocToken) { 0 };
-}
-
 static inline bool
 C_PpAssertToken(C_PpContext* pp, C_PpTokenReader* rd, C_TokenKind kind)
 {
@@ -231,20 +366,6 @@ C_PpTryEatToken(C_PpTokenReader* rd, C_TokenKind kind)
 	return false;
 }
 
-static C_PreprocTokenList**
-C_PpQueueToken(C_PreprocTokenList** ptoks, Arena* arena, const C_PreprocToken* token, C_PreprocHideset* hideset, C_SourceLocation* included_from, C_SourceLocation* expanded_from)
-{
-	C_PreprocTokenList* item = Arena_PushStruct(arena, C_PreprocTokenList);
-	item->tok = *token;
-	item->next = *ptoks;
-	item->hideset = hideset;
-	item->included_from = included_from;
-	item->expanded_from = expanded_from;
-	*ptoks = item;
-	
-	return &item->next;
-}
-
 static inline uint32
 C_PpEatTokenBalanced(C_PpTokenReader* rd, C_TokenKind open, C_TokenKind close, int32 start_at)
 {
@@ -265,216 +386,702 @@ C_PpEatTokenBalanced(C_PpTokenReader* rd, C_TokenKind open, C_TokenKind close, i
 	return eaten;
 }
 
-//~ NOTE(ljre): Writing output tokens
-static void
-C_PpWriteToken(C_PpContext* pp, const C_PreprocToken* pptok, C_SourceLocation* included_from, C_SourceLocation* expanded_from)
+//~ NOTE(ljre): Hidesets
+static bool
+C_PpHidesetContains(const C_PreprocHideset* set, C_SymbolId symbol)
 {
-	C_SourceLocation* loc = &(C_SourceLocation) {
-		.included_from = included_from,
-		.expanded_from = expanded_from,
-		.filepath = pp->current_file->path,
-		.leading_spaces = pptok->leading_spaces,
-		.line = pptok->line,
-		.col = pptok->col,
-	};
+	if (!set)
+		return false;
 	
-	loc = Arena_PushStructData(pp->tu->loc_arena, C_SourceLocation, loc);
+	uint32 low = 0;
+	uint32 high = set->count;
 	
-	C_TokenKind kind = pptok->kind;
-	if (kind == C_TokenKind_Identifier)
+	while (low < high)
 	{
-		C_TokenKind kw = C_FindKeywordByName(pptok->as_string);
+		uint32 mid = low + (high - low) / 2;
 		
-		if (kw)
-			kind = kw;
+		if (set->symbols[mid] < symbol)
+			low = mid + 1;
+		else
+			high = mid;
 	}
 	
-	String as_string = Arena_PushString(pp->tu->tree_arena, pptok->as_string);
-	Assert(as_string.size <= UINT32_MAX);
+	return low < set->count && set->symbols[low] == symbol;
+}
+
+static void
+C_PpGrowHidesetTable(C_PpContext* pp)
+{
+	uint32 old_cap = pp->hidesets ? 1u << pp->hidesets_log2cap : 0;
+	C_PreprocHideset** old_hidesets = pp->hidesets;
 	
-	Arena_PushData(pp->tu->array_arena, (&(C_Token) { kind, as_string.size, as_string.data, loc }));
-	pp->output.size++;
+	pp->hidesets_log2cap = old_hidesets ? pp->hidesets_log2cap + 1 : 10;
+	pp->hidesets = Arena_PushArray(pp->tu->stage_arena, C_PreprocHideset*, 1u << pp->hidesets_log2cap);
+	
+	for (uint32 i = 0; i < old_cap; ++i)
+	{
+		C_PreprocHideset* set = old_hidesets[i];
+		if (!set)
+			continue;
+		
+		int32 index = (int32)set->hash;
+		do
+			index = Hash_Msi(pp->hidesets_log2cap, set->hash, index);
+		while (pp->hidesets[index]);
+		
+		pp->hidesets[index] = set;
+	}
 }
 
-//~ NOTE(ljre): Macros
-static C_Macro*
-C_PpFindMacro(C_PpContext* pp, String name)
+// NOTE(ljre): Returns the unique hideset with the given sorted symbols, creating it if needed.
+//             'symbols' may be temporary.
+static C_PreprocHideset*
+C_PpInternHideset(C_PpContext* pp, const C_SymbolId* symbols, uint32 count)
 {
-	uint64 hash = Hash_StringHash(name);
+	if (count == 0)
+		return NULL;
+	
+	if (pp->hidesets_count >= (1u << pp->hidesets_log2cap) / 2)
+		C_PpGrowHidesetTable(pp);
+	
+	uintsize size = sizeof(C_SymbolId) * count;
+	uint64 hash = Hash_StringHash(StrMake(size, symbols));
 	int32 index = (int32)hash;
-	C_HashMapChunk* map = pp->tu->macros_hashmap;
 	
 	for (;;)
 	{
-		index = Hash_Msi(map->log2cap, hash, index);
-		C_Macro** pmacro = (C_Macro**)map->memory + index;
+		index = Hash_Msi(pp->hidesets_log2cap, hash, index);
+		C_PreprocHideset* set = pp->hidesets[index];
 		
-		if (*pmacro)
-		{
-			C_Macro* macro = *pmacro;
-			
-			if (String_Equals(name, macro->name))
-				return macro;
-			
-			if (macro->is_defined && macro->name.size > 0)
-				continue;
-		}
-		
-		if (map->size >= 1 << (map->log2cap-1))
-		{
-			if (!map->next)
-				return NULL;
-			
-			map = map->next;
-			index = (int32)hash;
-			continue;
-		}
+		if (!set)
+			break;
 		
-		return NULL;
+		if (set->hash == hash && set->count == count && Mem_Compare(set->symbols, symbols, size) == 0)
+			return set;
 	}
+	
+	C_PreprocHideset* set = Arena_PushAligned(pp->tu->stage_arena, sizeof(C_PreprocHideset) + size, alignof(C_PreprocHideset));
+	set->hash = hash;
+	set->count = count;
+	Mem_Copy(set->symbols, symbols, size);
+	
+	pp->hidesets[index] = set;
+	++pp->hidesets_count;
+	
+	return set;
 }
 
-static C_Macro*
-C_PpInsertMacroToHashmap(C_PpContext* pp, const C_Macro* macro_def)
+// NOTE(ljre): Returns 'set' with 'symbol' added to it. Results are memoized, since the same macro keeps
+//             being expanded with the same hideset over and over.
+static C_PreprocHideset*
+C_PpHidesetInsert(C_PpContext* pp, C_PreprocHideset* set, C_SymbolId symbol)
 {
-	String name = macro_def->name;
-	uint64 hash = Hash_StringHash(name);
-	int32 index = (int32)hash;
-	C_HashMapChunk* map = pp->tu->macros_hashmap;
+	if (C_PpHidesetContains(set, symbol))
+		return set;
 	
-	for (;;)
+	uint64 key = Hash_IntHash64((uint64)(uintptr)set ^ (uint64)symbol << 48 ^ symbol);
+	C_PpHidesetMemo* memo = &pp->hideset_memo[key & (C_PP_HIDESET_MEMO_SIZE - 1)];
+	
+	if (memo->result && memo->set == set && memo->symbol == symbol)
+		return memo->result;
+	
+	C_PreprocHideset* result = NULL;
+	uint32 count = set ? set->count : 0;
+	
+	for Arena_TempScope(pp->tu->scratch_arena)
 	{
-		index = Hash_Msi(map->log2cap, hash, index);
-		C_Macro** pmacro = (C_Macro**)map->memory + index;
+		C_SymbolId* symbols = Arena_PushArray(pp->tu->scratch_arena, C_SymbolId, count + 1);
+		uint32 i = 0;
 		
-		if (*pmacro)
-		{
-			C_Macro* macro = *pmacro;
-			
-			if (String_Equals(macro->name, macro_def->name))
-				Assert(false);
-			
-			if (macro->is_defined && macro->name.size > 0)
-				continue;
-		}
+		for (; i < count && set->symbols[i] < symbol; ++i)
+			symbols[i] = set->symbols[i];
+		symbols[i] = symbol;
+		for (; i < count; ++i)
+			symbols[i+1] = set->symbols[i];
+		
+		result = C_PpInternHideset(pp, symbols, count + 1);
+	}
+	
+	memo->set = set;
+	memo->symbol = symbol;
+	memo->result = result;
+	
+	return result;
+}
+
+// NOTE(ljre): Returns the union of both sets. Hidesets are interned, so equal sets are the same pointer.
+static C_PreprocHideset*
+C_PpHidesetUnion(C_PpContext* pp, C_PreprocHideset* a, C_PreprocHideset* b)
+{
+	if (!a || a == b)
+		return b;
+	if (!b)
+		return a;
+	if (a->count == 1)
+		return C_PpHidesetInsert(pp, b, a->symbols[0]);
+	if (b->count == 1)
+		return C_PpHidesetInsert(pp, a, b->symbols[0]);
+	
+	C_PreprocHideset* result = NULL;
+	
+	for Arena_TempScope(pp->tu->scratch_arena)
+	{
+		C_SymbolId* symbols = Arena_PushArray(pp->tu->scratch_arena, C_SymbolId, a->count + b->count);
+		uint32 count = 0;
+		uint32 i = 0;
+		uint32 j = 0;
 		
-		if (map->size >= 1 << (map->log2cap-1))
+		while (i < a->count && j < b->count)
 		{
-			if (!map->next)
+			if (a->symbols[i] < b->symbols[j])
+				symbols[count++] = a->symbols[i++];
+			else if (a->symbols[i] > b->symbols[j])
+				symbols[count++] = b->symbols[j++];
+			else
 			{
-				map->next = C_AllocHashMapChunk(pp->tu->stage_arena, Min(map->log2cap+1, 20), sizeof(C_Macro*));
-				map = map->next;
-				index = Hash_Msi(map->log2cap, hash, (int32)hash);
-				pmacro = (C_Macro**)map->memory + index;
-				
-				goto insert_in_map;
+				symbols[count++] = a->symbols[i++];
+				++j;
 			}
-			
-			map = map->next;
-			index = (int32)hash;
-			continue;
 		}
 		
-		insert_in_map:;
-		C_Macro* macro = Arena_PushStructData(pp->tu->stage_arena, C_Macro, macro_def);
-		macro->is_defined = true;
+		while (i < a->count)
+			symbols[count++] = a->symbols[i++];
+		while (j < b->count)
+			symbols[count++] = b->symbols[j++];
 		
-		*pmacro = macro;
-		return macro;
+		result = C_PpInternHideset(pp, symbols, count);
 	}
 	
-	return NULL;
+	return result;
+}
+
+//~ NOTE(ljre): Writing output tokens
+// NOTE(ljre): Hands every token written so far to whoever is reading 'tu->output_pipe'.
+static void
+C_PpPublishOutput(C_PpContext* pp, bool done)
+{
+	C_OutputPipe* pipe = pp->tu->output_pipe;
+	
+	Atomic_Store32(&pipe->published, pp->output.size);
+	if (done)
+		Atomic_Store32(&pipe->done, 1);
+	
+	Atomic_FetchAdd32(&pipe->sequence, 1);
+	OS_WakeAllOnAddress(&pipe->sequence);
 }
 
 static void
-C_PpDefineBuiltinMacros(C_PpContext* pp)
+C_PpWriteToken(C_PpContext* pp, const C_PreprocToken* pptok, C_SourceLoc loc)
 {
-	static const C_Macro arr[] = {
-		{ .name = StrInit("__LINE__"), .builtin_id = C_PpBuiltinMacro_Line, },
-		{ .name = StrInit("__FILE__"), .builtin_id = C_PpBuiltinMacro_File, },
+	C_TokenKind kind = pptok->kind;
+	if (kind == C_TokenKind_Identifier)
+	{
+		C_TokenKind kw = C_KeywordFromSymbol(pptok->symbol);
+		
+		if (kw)
+			kind = kw;
+	}
+	
+	String as_string = pptok->as_string;
+	Assert(as_string.size <= UINT32_MAX);
+	
+	uint32* str_size = Arena_PushDirtyAligned(pp->tu->tree_arena, sizeof(uint32) + as_string.size, alignof(uint32));
+	*str_size = (uint32)as_string.size;
+	Mem_Copy(str_size + 1, as_string.data, as_string.size);
+	
+	C_Token tok = {
+		.kind = kind,
+		.leading_spaces = (uint16)Min(pptok->leading_spaces, UINT16_MAX),
+		.loc = loc,
+		.str_data = (const uint8*)(str_size + 1),
 	};
 	
-	for (int32 i = 0; i < ArrayLength(arr); ++i)
-		C_PpInsertMacroToHashmap(pp, &arr[i]);
+	Arena_PushStructData(pp->tu->array_arena, C_Token, &tok);
+	pp->output.size++;
+	
+	if (pp->tu->output_pipe && pp->output.size % C_PP_OUTPUT_PUBLISH_BATCH == 0)
+		C_PpPublishOutput(pp, false);
 }
 
+//~ NOTE(ljre): Source locations
 static void
-C_PpPredefineMacros(C_PpContext* pp, const String* macros, uintsize count)
+C_PpInitLocTable(C_TuContext* tu)
 {
-	// TODO
+	// NOTE(ljre): File location 0 is no location, so the first file starts at 1.
+	tu->locs = (C_LocTable) {
+		.next_base = 1,
+		.expansions = Arena_EndAligned(tu->loc_arena, alignof(C_LocExpansion)),
+	};
 }
 
 static uint32
-C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
+C_PpPushLocFile(C_PpContext* pp, C_LoadedFile* file, C_SourceLoc included_from)
 {
-	Assert(macro);
-	uint32 result = 0;
+	C_LocTable* table = &pp->tu->locs;
+	uint32 base = table->next_base;
 	
-	C_SourceLocation* included_from = rd->list->included_from;
-	C_SourceLocation* expanded_from = rd->list->expanded_from;
+	// NOTE(ljre): There's no fallback, just die if a TU goes through 2GB worth of files.
+	SafeAssert(file->contents.size < C_SOURCE_LOC_EXPANSION_BIT - base);
+	table->next_base += (uint32)file->contents.size + 1;
 	
-	if (macro->builtin_id)
+	if (table->file_count >= table->file_cap)
 	{
-		result = 1;
-		C_PreprocToken tok = {
-			.kind = C_TokenKind_Null,
-			.as_string = { 0 },
-			
-			.leading_spaces = rd->tok.leading_spaces,
-			.line = rd->tok.line,
-			.col = rd->tok.col,
-		};
-		
-		switch (macro->builtin_id)
-		{
-			case C_PpBuiltinMacro_Line:
-			{
-				tok.kind = C_TokenKind_IntLiteral;
-				tok.as_string = Arena_Printf(pp->tu->stage_arena, "%u", tok.line);
-			} break;
-			
-			case C_PpBuiltinMacro_File:
-			{
-				tok.kind = C_TokenKind_StringLiteral;
-				tok.as_string = C_PpStringifyString(pp->tu->stage_arena, pp->current_file->path);
-			} break;
-			
-			default: Unreachable(); break;
-		}
+		uint32 new_cap = table->file_cap ? table->file_cap * 2 : 64;
+		C_LocFile* new_files = Arena_PushArray(pp->tu->tree_arena, C_LocFile, new_cap);
 		
-		C_PpNextToken(rd);
-		C_PpQueueToken(&rd->list, pp->tu->scratch_arena, &tok, NULL, included_from, expanded_from);
-		rd->tok = rd->list->tok;
+		if (table->file_count > 0)
+			Mem_Copy(new_files, table->files, sizeof(C_LocFile) * table->file_count);
 		
-		return result;
+		Atomic_StorePtr((void* volatile*)&table->files, new_files);
+		table->file_cap = new_cap;
 	}
 	
-	C_SourceLocation* this_loc = &(C_SourceLocation) {
+	table->files[table->file_count] = (C_LocFile) {
+		.file = file,
 		.included_from = included_from,
-		.expanded_from = expanded_from,
-		.filepath = pp->current_file->path,
-		.leading_spaces = rd->tok.leading_spaces,
-		.line = rd->tok.line,
-		.col = rd->tok.col,
+		.base = base,
 	};
 	
-	this_loc = Arena_PushStructData(pp->tu->loc_arena, C_SourceLocation, this_loc);
+	Atomic_Store32(&table->file_count, table->file_count + 1);
 	
-	C_PreprocHideset* hideset = Arena_PushStruct(pp->tu->scratch_arena, C_PreprocHideset);
-	hideset->next = rd->list->hideset;
-	hideset->name = rd->tok.as_string;
+	return base;
+}
+
+// NOTE(ljre): The line where the outermost macro was used, which is what __LINE__ expands to.
+static uint32
+C_PpLineOfLoc(C_PpContext* pp, C_SourceLoc loc)
+{
+	loc = C_GetFileLoc(&pp->tu->locs, loc);
 	
-	if (!macro->is_func_like)
-	{
-		C_PpNextToken(rd);
-		result = macro->replacement_count;
-		
-		C_PreprocTokenList** head = &rd->list;
-		C_PreprocTokenList* macro_head = macro->replacement;
+	const C_LocFile* loc_file = C_FindLocFile(&pp->tu->locs, loc);
+	if (!loc_file)
+		return 0;
+	
+	// NOTE(ljre): The index is shared by everyone who sees this file, so it's pushed to 'cache_arena'.
+	const C_LineIndex* lines = C_GetLineIndex(loc_file->file, pp->tu->cache_arena);
+	
+	uint32 line, col;
+	C_LineColumnFromOffset(lines, loc - loc_file->base, &line, &col);
+	
+	return line;
+}
+
+static inline uint64
+C_PpExpansionHash(C_SourceLoc expanded_from, C_SymbolId macro)
+{ return Hash_IntHash64((uint64)expanded_from << 32 | macro); }
+
+static void
+C_PpGrowExpansionTable(C_PpContext* pp)
+{
+	uint32 old_cap = pp->expansion_slots ? 1u << pp->expansion_slots_log2cap : 0;
+	uint32* old_slots = pp->expansion_slots;
+	const C_LocExpansion* expansions = pp->tu->locs.expansions;
+	
+	pp->expansion_slots_log2cap = old_slots ? pp->expansion_slots_log2cap + 1 : 10;
+	pp->expansion_slots = Arena_PushArray(pp->tu->stage_arena, uint32, 1u << pp->expansion_slots_log2cap);
+	
+	for (uint32 i = 0; i < old_cap; ++i)
+	{
+		uint32 slot = old_slots[i];
+		if (!slot)
+			continue;
+		
+		const C_LocExpansion* expansion = &expansions[slot-1];
+		uint64 hash = C_PpExpansionHash(expansion->expanded_from, expansion->macro);
+		int32 index = (int32)hash;
+		
+		do
+			index = Hash_Msi(pp->expansion_slots_log2cap, hash, index);
+		while (pp->expansion_slots[index]);
+		
+		pp->expansion_slots[index] = slot;
+	}
+}
+
+// NOTE(ljre): Returns the expansion record of 'macro' used at 'expanded_from', creating it if needed.
+//             Every macro used in a single expansion has the same 'expanded_from', so records are
+//             hash-consed: a macro used twice in another's body, or expanded again at the same place,
+//             reuses the first record.
+static C_SourceLoc
+C_PpPushLocExpansion(C_PpContext* pp, C_SourceLoc expanded_from, C_SymbolId macro)
+{
+	C_LocTable* table = &pp->tu->locs;
+	
+	if (table->expansion_count >= (pp->expansion_slots ? 1u << pp->expansion_slots_log2cap : 0) / 2)
+		C_PpGrowExpansionTable(pp);
+	
+	uint64 hash = C_PpExpansionHash(expanded_from, macro);
+	int32 index = (int32)hash;
+	
+	for (;;)
+	{
+		index = Hash_Msi(pp->expansion_slots_log2cap, hash, index);
+		uint32 slot = pp->expansion_slots[index];
+		
+		if (!slot)
+			break;
+		
+		const C_LocExpansion* expansion = &table->expansions[slot-1];
+		if (expansion->expanded_from == expanded_from && expansion->macro == macro)
+			return C_SOURCE_LOC_EXPANSION_BIT | (slot-1);
+	}
+	
+	SafeAssert(table->expansion_count < C_SOURCE_LOC_EXPANSION_BIT - 1);
+	
+	C_LocExpansion* expansion = Arena_PushStruct(pp->tu->loc_arena, C_LocExpansion);
+	Assert(expansion == &table->expansions[table->expansion_count]);
+	
+	expansion->expanded_from = expanded_from;
+	expansion->macro = macro;
+	
+	pp->expansion_slots[index] = ++table->expansion_count;
+	
+	return C_SOURCE_LOC_EXPANSION_BIT | (table->expansion_count - 1);
+}
+
+//~ NOTE(ljre): Macros
+enum
+{
+	C_PP_MACRO_GROUP_SIZE = 16,
+	C_PP_MACRO_CTRL_EMPTY = 0x80,
+	C_PP_MACRO_CTRL_DELETED = 0xFE,
+};
+
+// NOTE(ljre): Bit i is set if the control byte i of the group is 'byte'.
+static inline uint32
+C_PpMacroGroupMatch(const uint8* group, uint8 byte)
+{
+	__m128i ctrl = _mm_load_si128((const __m128i*)group);
+	return (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte)));
+}
+
+// NOTE(ljre): Bit i is set if the slot i of the group is empty or deleted, since those are the only
+//             control bytes with the high bit set.
+static inline uint32
+C_PpMacroGroupFree(const uint8* group)
+{
+	__m128i ctrl = _mm_load_si128((const __m128i*)group);
+	return (uint32)_mm_movemask_epi8(ctrl);
+}
+
+static void
+C_PpAllocMacroTable(C_PpContext* pp, uint32 log2cap)
+{
+	C_MacroTable* table = &pp->tu->macro_table;
+	uint32 cap = 1u << log2cap;
+	
+	table->log2cap = log2cap;
+	table->count = 0;
+	table->deleted = 0;
+	table->ctrl = Arena_PushDirtyAligned(pp->tu->stage_arena, cap, C_PP_MACRO_GROUP_SIZE);
+	table->slots = Arena_PushArray(pp->tu->stage_arena, C_Macro*, cap);
+	
+	Mem_Set(table->ctrl, C_PP_MACRO_CTRL_EMPTY, cap);
+}
+
+// NOTE(ljre): Groups are probed in triangular steps, which visits all of them once the number of groups
+//             is a power of 2. Returns the first free slot on the way, so the symbol must not be in the
+//             table.
+static uint32
+C_PpFindFreeMacroSlot(const C_MacroTable* table, uint64 hash)
+{
+	uint32 group_mask = (1u << table->log2cap) / C_PP_MACRO_GROUP_SIZE - 1;
+	uint32 group = (uint32)(hash >> 7) & group_mask;
+	
+	for (uint32 step = 1;; ++step)
+	{
+		uint32 free = C_PpMacroGroupFree(table->ctrl + group * C_PP_MACRO_GROUP_SIZE);
+		
+		if (free)
+			return group * C_PP_MACRO_GROUP_SIZE + Mem_BitCtz32(free);
+		
+		group = (group + step) & group_mask;
+	}
+}
+
+// NOTE(ljre): Rebuilds the table with the given capacity, which also drops every tombstone. The old
+//             arrays are left in the stage arena.
+static void
+C_PpRehashMacroTable(C_PpContext* pp, uint32 log2cap)
+{
+	C_MacroTable old = pp->tu->macro_table;
+	C_MacroTable* table = &pp->tu->macro_table;
+	
+	C_PpAllocMacroTable(pp, log2cap);
+	
+	for (uint32 i = 0; i < 1u << old.log2cap; ++i)
+	{
+		if (old.ctrl[i] & 0x80)
+			continue;
+		
+		C_Macro* macro = old.slots[i];
+		uint64 hash = Hash_IntHash64(macro->symbol);
+		uint32 index = C_PpFindFreeMacroSlot(table, hash);
+		
+		table->ctrl[index] = (uint8)(hash & 0x7F);
+		table->slots[index] = macro;
+	}
+	
+	table->count = old.count;
+}
+
+// NOTE(ljre): Makes sure 'extra_count' more macros fit before the table is 7/8 full (counting
+//             tombstones). If it's mostly tombstones, it's just compacted instead of grown.
+static void
+C_PpReserveMacros(C_PpContext* pp, uint32 extra_count)
+{
+	C_MacroTable* table = &pp->tu->macro_table;
+	uint32 limit = (1u << table->log2cap) / 8 * 7;
+	
+	if (table->count + table->deleted + extra_count <= limit)
+		return;
+	
+	uint32 log2cap = table->log2cap;
+	while ((table->count + extra_count) * 2 > (1u << log2cap) / 8 * 7)
+		++log2cap;
+	
+	C_PpRehashMacroTable(pp, log2cap);
+}
+
+// NOTE(ljre): Returns the slot of 'symbol', or -1. This runs once per identifier token and most of them
+//             aren't macros, so misses matter the most: one usually ends in the first group, as soon as it
+//             has an empty control byte.
+static int32
+C_PpFindMacroSlot(const C_MacroTable* table, C_SymbolId symbol)
+{
+	uint64 hash = Hash_IntHash64(symbol);
+	uint8 h2 = (uint8)(hash & 0x7F);
+	uint32 group_mask = (1u << table->log2cap) / C_PP_MACRO_GROUP_SIZE - 1;
+	uint32 group = (uint32)(hash >> 7) & group_mask;
+	
+	for (uint32 step = 1;; ++step)
+	{
+		const uint8* ctrl = table->ctrl + group * C_PP_MACRO_GROUP_SIZE;
+		uint32 matches = C_PpMacroGroupMatch(ctrl, h2);
+		
+		while (matches)
+		{
+			int32 index = group * C_PP_MACRO_GROUP_SIZE + Mem_BitCtz32(matches);
+			
+			if (table->slots[index]->symbol == symbol)
+				return index;
+			
+			matches &= matches - 1;
+		}
+		
+		if (C_PpMacroGroupMatch(ctrl, C_PP_MACRO_CTRL_EMPTY))
+			return -1;
+		
+		group = (group + step) & group_mask;
+	}
+}
+
+static C_Macro*
+C_PpFindMacro(C_PpContext* pp, C_SymbolId symbol)
+{
+	int32 index = C_PpFindMacroSlot(&pp->tu->macro_table, symbol);
+	return (index >= 0) ? pp->tu->macro_table.slots[index] : NULL;
+}
+
+static bool
+C_PpIsMacroDefined(C_PpContext* pp, C_SymbolId symbol)
+{
+	return C_PpFindMacro(pp, symbol) != NULL;
+}
+
+static C_Macro*
+C_PpInsertMacroToHashmap(C_PpContext* pp, const C_Macro* macro_def)
+{
+	// NOTE(ljre): Redefinition. Just reuse it.
+	C_Macro* macro = C_PpFindMacro(pp, macro_def->symbol);
+	
+	if (macro)
+	{
+		*macro = *macro_def;
+		return macro;
+	}
+	
+	C_PpReserveMacros(pp, 1);
+	
+	C_MacroTable* table = &pp->tu->macro_table;
+	uint64 hash = Hash_IntHash64(macro_def->symbol);
+	uint32 index = C_PpFindFreeMacroSlot(table, hash);
+	
+	if (table->ctrl[index] == C_PP_MACRO_CTRL_DELETED)
+		--table->deleted;
+	
+	macro = Arena_PushStructData(pp->tu->stage_arena, C_Macro, macro_def);
+	table->ctrl[index] = (uint8)(hash & 0x7F);
+	table->slots[index] = macro;
+	++table->count;
+	
+	return macro;
+}
+
+// NOTE(ljre): Leaves a tombstone, since other symbols may have probed past this slot. They're dropped
+//             the next time the table is rehashed.
+static bool
+C_PpRemoveMacro(C_PpContext* pp, C_SymbolId symbol)
+{
+	C_MacroTable* table = &pp->tu->macro_table;
+	int32 index = C_PpFindMacroSlot(table, symbol);
+	
+	if (index < 0)
+		return false;
+	
+	table->ctrl[index] = C_PP_MACRO_CTRL_DELETED;
+	table->slots[index] = NULL;
+	--table->count;
+	++table->deleted;
+	
+	return true;
+}
+
+static void
+C_PpDefineBuiltinMacros(C_PpContext* pp)
+{
+	static const C_Macro arr[] = {
+		{ .name = StrInit("__LINE__"), .symbol = C_KnownSymbol_LineMacro, .builtin_id = C_PpBuiltinMacro_Line, },
+		{ .name = StrInit("__FILE__"), .symbol = C_KnownSymbol_FileMacro, .builtin_id = C_PpBuiltinMacro_File, },
+	};
+	
+	for (int32 i = 0; i < ArrayLength(arr); ++i)
+		C_PpInsertMacroToHashmap(pp, &arr[i]);
+}
+
+// NOTE(ljre): The table is still empty when this is called, so there's nothing to compare against: the
+//             macros are copied in one go and each one just goes to the first free slot.
+static void
+C_PpPredefineMacros(C_PpContext* pp, const C_PredefinedMacros* predefined)
+{
+	C_MacroTable* table = &pp->tu->macro_table;
+	uint32 count = predefined->count;
+	
+	Assert(table->count == 0 && table->deleted == 0);
+	C_PpReserveMacros(pp, count);
+	
+	C_Macro* macros = Arena_PushArrayData(pp->tu->stage_arena, C_Macro, predefined->macros, count);
+	
+	for (uint32 i = 0; i < count; ++i)
+	{
+		uint64 hash = Hash_IntHash64(macros[i].symbol);
+		uint32 index = C_PpFindFreeMacroSlot(table, hash);
+		
+		table->ctrl[index] = (uint8)(hash & 0x7F);
+		table->slots[index] = &macros[i];
+	}
+	
+	table->count = count;
+}
+
+struct C_PpMacroArg
+{
+	bool is_va_arg;
+	uint32 count;
+	C_PpTokenReader value;
+	
+	// NOTE(ljre): Fully macro-expanded 'value', made the first time the argument is used outside of
+	//             '#' and '##'. Every other use copies this list.
+	bool is_expanded;
+	C_PreprocTokenList* expanded;
+}
+typedef C_PpMacroArg;
+
+static void
+C_PpExpandMacroArg(C_PpContext* pp, C_PpMacroArg* arg)
+{
+	if (arg->is_expanded)
+		return;
+	
+	// NOTE(ljre): The argument keeps its own hidesets here. The invocation's one is only added when the
+	//             result is substituted, otherwise 'F(F(x))' would never expand the inner 'F'.
+	C_PreprocTokenList* list = NULL;
+	C_PreprocTokenList** head = &list;
+	C_PpTokenReader it = arg->value;
+	
+	for (uint32 i = 0; i < arg->count; ++i, C_PpNextToken(&it))
+		head = C_PpQueueToken(head, pp->tu->scratch_arena, &it.tok, C_PpTokenHideset(&it), C_PpTokenLoc(pp, &it));
+	
+	// NOTE(ljre): A result is rescanned, since it might be the name of a function-like macro whose
+	//             arguments follow.
+	C_PreprocTokenList** itp = &list;
+	while (*itp)
+	{
+		if ((*itp)->tok.kind == C_TokenKind_Identifier)
+		{
+			C_PpTokenReader local_rd = C_PpMakeTokenReader(*itp, NULL, 0);
+			
+			if (C_PpTryToExpandMacro(pp, &local_rd, NULL))
+			{
+				*itp = local_rd.list;
+				continue;
+			}
+		}
+		
+		itp = &(*itp)->next;
+	}
+	
+	arg->is_expanded = true;
+	arg->expanded = list;
+}
+
+static uint32
+C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
+{
+	Assert(macro);
+	uint32 result = 0;
+	
+	C_SourceLoc site_loc = C_PpTokenLoc(pp, rd);
+	
+	if (macro->builtin_id)
+	{
+		result = 1;
+		C_PreprocToken tok = {
+			.kind = C_TokenKind_Null,
+			.as_string = { 0 },
+			
+			.leading_spaces = rd->tok.leading_spaces,
+		};
+		
+		switch (macro->builtin_id)
+		{
+			case C_PpBuiltinMacro_Line:
+			{
+				tok.kind = C_TokenKind_IntLiteral;
+				tok.as_string = Arena_Printf(pp->tu->stage_arena, "%u", C_PpLineOfLoc(pp, site_loc));
+			} break;
+			
+			case C_PpBuiltinMacro_File:
+			{
+				tok.kind = C_TokenKind_StringLiteral;
+				tok.as_string = C_PpStringifyString(pp->tu->stage_arena, pp->current_file->path);
+			} break;
+			
+			default: Unreachable(); break;
+		}
+		
+		C_PpNextToken(rd);
+		C_PpQueueToken(&rd->list, pp->tu->scratch_arena, &tok, NULL, site_loc);
+		C_PpSyncToken(rd);
+		
+		return result;
+	}
+	
+	C_SourceLoc this_loc = C_PpPushLocExpansion(pp, site_loc, macro->symbol);
+	
+	C_PreprocHideset* hideset = C_PpHidesetInsert(pp, C_PpTokenHideset(rd), rd->tok.symbol);
+	
+	if (!macro->is_func_like)
+	{
+		C_PpNextToken(rd);
+		result = macro->replacement_count;
+		
+		C_PreprocTokenList** head = &rd->list;
+		C_PreprocTokenList* macro_head = macro->replacement;
 		
 		for (int32 i = 0; i < macro->replacement_count; ++i)
 		{
-			head = C_PpQueueToken(head, pp->tu->scratch_arena, &macro_head->tok, hideset, NULL, this_loc);
+			head = C_PpQueueToken(head, pp->tu->scratch_arena, &macro_head->tok, hideset, this_loc);
 			macro_head = macro_head->next;
 		}
 	}
@@ -484,22 +1091,14 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 		C_PpEatToken(pp, rd, C_TokenKind_LeftParen);
 		
 		//- NOTE(ljre): Read arguments
-		struct MacroArg
-		{
-			bool is_va_arg;
-			uint32 count;
-			C_PreprocTokenList* value;
-		}
-		typedef MacroArg;
-		
-		MacroArg* args = Arena_PushArray(pp->tu->scratch_arena, MacroArg, macro->param_count);
+		C_PpMacroArg* args = Arena_PushArray(pp->tu->scratch_arena, C_PpMacroArg, macro->param_count);
 		
 		for (int32 i = 0; i < macro->param_count - macro->has_va_args; ++i)
 		{
-			MacroArg* arg = &args[i];
+			C_PpMacroArg* arg = &args[i];
 			
 			arg->count = 0;
-			arg->value = rd->list;
+			arg->value = *rd;
 			int32 balance = 1;
 			
 			while (rd->tok.kind)
@@ -522,11 +1121,12 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 		
 		if (macro->has_va_args)
 		{
-			MacroArg* arg = &args[macro->param_count-1];
+			C_PpMacroArg* arg = &args[macro->param_count-1];
 			
 			arg->is_va_arg = true;
-			arg->value = rd->list;
+			arg->value = *rd;
 			arg->count = C_PpEatTokenBalanced(rd, C_TokenKind_LeftParen, C_TokenKind_RightParen, 1);
+			C_PpEatToken(pp, rd, C_TokenKind_RightParen);
 		}
 		else if (!C_PpTryEatToken(rd, C_TokenKind_RightParen))
 		{
@@ -554,7 +1154,7 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 						
 						while (count --> 0)
 						{
-							head = C_PpQueueToken(head, pp->tu->scratch_arena, &it->tok, hideset, NULL, this_loc);
+							head = C_PpQueueToken(head, pp->tu->scratch_arena, &it->tok, hideset, this_loc);
 							it = it->next;
 						}
 					} break;
@@ -564,43 +1164,14 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 						int32 param_index = inst->argument.param_index;
 						Assert(param_index >= 0 && param_index < macro->param_count);
 						
-						C_PreprocTokenList** first = head;
-						C_PreprocTokenList* it = args[param_index].value;
-						uint32 count = args[param_index].count;
-						uint32 remaining = count;
-						
-						while (remaining --> 0)
-						{
-							head = C_PpQueueToken(head, pp->tu->scratch_arena, &it->tok, hideset, NULL, this_loc);
-							it = it->next;
-						}
+						C_PpMacroArg* arg = &args[param_index];
+						C_PpExpandMacroArg(pp, arg);
 						
-						C_PreprocTokenList** itp = first;
-						for (int32 i = 0; i < count; ++i)
+						C_PreprocTokenList** first = head;
+						for (C_PreprocTokenList* it = arg->expanded; it; it = it->next)
 						{
-							if ((*itp)->tok.kind == C_TokenKind_Identifier)
-							{
-								C_PpTokenReader* local_rd = &(C_PpTokenReader) { *itp, (*itp)->tok };
-								uint32 added_count;
-								
-								if (C_PpTryToExpandMacro(pp, local_rd, &added_count))
-								{
-									*itp = local_rd->list;
-									if (i == count - 1)
-									{
-										head = itp;
-										while (added_count --> 0)
-											head = &(*head)->next;
-									}
-									else
-									{
-										while (*head)
-											head = &(*head)->next;
-									}
-								}
-							}
-							else
-								itp = &(*itp)->next;
+							C_PreprocHideset* tok_hideset = C_PpHidesetUnion(pp, it->hideset, hideset);
+							head = C_PpQueueToken(head, pp->tu->scratch_arena, &it->tok, tok_hideset, this_loc);
 						}
 						
 						if (*first)
@@ -614,7 +1185,7 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 						int32 param_index = inst->argument.param_index;
 						Assert(param_index >= 0 && param_index < macro->param_count);
 						
-						C_PreprocTokenList* tokens = args[param_index].value;
+						C_PpTokenReader tokens = args[param_index].value;
 						uint32 count = args[param_index].count;
 						
 						String str = C_PpStringifyTokens(pp->tu->stage_arena, tokens, count);
@@ -622,11 +1193,9 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 						C_PreprocTokenList* tok = Arena_PushStruct(pp->tu->scratch_arena, C_PreprocTokenList);
 						tok->next = NULL;
 						tok->hideset = hideset;
-						tok->expanded_from = this_loc;
+						tok->loc = this_loc;
 						tok->tok = (C_PreprocToken) {
 							.kind = C_TokenKind_StringLiteral,
-							.line = macro->definition_loc->line,
-							.col = macro->definition_loc->col,
 							.leading_spaces = inst->stringify.leading_spaces,
 							.as_string = str,
 						};
@@ -642,25 +1211,25 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 						
 						C_PreprocTokenList** first = head;
 						C_PreprocTokenList* token_to_concat = inst->glue.token;
-						C_PreprocTokenList* it = args[param_index].value;
+						C_PpTokenReader it = args[param_index].value;
 						uint32 count = args[param_index].count;
 						
 						if (count == 0)
 						{
 							// NOTE(ljre): Nothing to concat with, so just copy the token
-							head = C_PpQueueToken(head, pp->tu->scratch_arena, &token_to_concat->tok, hideset, NULL, this_loc);
+							head = C_PpQueueToken(head, pp->tu->scratch_arena, &token_to_concat->tok, hideset, this_loc);
 						}
 						else
 						{
 							// NOTE(ljre): Copy all leading tokens of argument, excluding last
 							while (count --> 1)
 							{
-								head = C_PpQueueToken(head, pp->tu->scratch_arena, &it->tok, hideset, NULL, this_loc);
-								it = it->next;
+								head = C_PpQueueToken(head, pp->tu->scratch_arena, &it.tok, hideset, this_loc);
+								C_PpNextToken(&it);
 							}
 							
 							// NOTE(ljre): Concat tokens
-							head = C_PpConcatTokens(pp, &it->tok, &token_to_concat->tok, head, hideset, this_loc);
+							head = C_PpConcatTokens(pp, &it.tok, &token_to_concat->tok, head, hideset, this_loc);
 						}
 						
 						(*first)->tok.leading_spaces = inst->glue.leading_spaces;
@@ -673,26 +1242,26 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 						
 						C_PreprocTokenList** first = head;
 						C_PreprocTokenList* token_to_concat = inst->glue.token;
-						C_PreprocTokenList* it = args[param_index].value;
+						C_PpTokenReader it = args[param_index].value;
 						uint32 count = args[param_index].count;
 						
 						if (count == 0)
 						{
 							// NOTE(ljre): Nothing to concat with, so just copy the token
-							head = C_PpQueueToken(head, pp->tu->scratch_arena, &token_to_concat->tok, hideset, NULL, this_loc);
+							head = C_PpQueueToken(head, pp->tu->scratch_arena, &token_to_concat->tok, hideset, this_loc);
 						}
 						else
 						{
 							// NOTE(ljre): Concat tokens
-							head = C_PpConcatTokens(pp, &token_to_concat->tok, &it->tok, head, hideset, this_loc);
-							it = it->next;
+							head = C_PpConcatTokens(pp, &token_to_concat->tok, &it.tok, head, hideset, this_loc);
+							C_PpNextToken(&it);
 							--count;
 							
 							// NOTE(ljre): Copy all trailling tokens of argument
 							while (count --> 0)
 							{
-								head = C_PpQueueToken(head, pp->tu->scratch_arena, &it->tok, hideset, NULL, this_loc);
-								it = it->next;
+								head = C_PpQueueToken(head, pp->tu->scratch_arena, &it.tok, hideset, this_loc);
+								C_PpNextToken(&it);
 							}
 						}
 						
@@ -707,32 +1276,26 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 						Assert(param2_index >= 0 && param2_index < macro->param_count);
 						
 						C_PreprocTokenList** first = head;
-						C_PreprocTokenList* it_left = args[param1_index].value;
-						C_PreprocTokenList* it_right = args[param2_index].value;
+						C_PpTokenReader it_left = args[param1_index].value;
+						C_PpTokenReader it_right = args[param2_index].value;
 						uint32 count_left = args[param1_index].count;
 						uint32 count_right = args[param2_index].count;
 						
 						if (count_left == 0 || count_right == 0)
 						{
 							// NOTE(ljre): Nothing to concat with, so just copy the tokens
-							C_PreprocTokenList* its[2] = { it_left, it_right, };
+							C_PpTokenReader its[2] = { it_left, it_right, };
 							uint32 counts[2] = { count_left, count_right, };
 							
 							for (int32 j = 0; j < 2; ++j)
 							{
-								C_PreprocTokenList* it = its[j];
+								C_PpTokenReader it = its[j];
 								uint32 count = counts[j];
 								
 								while (count --> 0)
 								{
-									C_PreprocTokenList* tok = Arena_PushStructData(pp->tu->scratch_arena, C_PreprocTokenList, it);
-									tok->next = NULL;
-									tok->hideset = hideset;
-									tok->expanded_from = this_loc;
-									
-									*head = tok;
-									head = &(*head)->next;
-									it = it->next;
+									head = C_PpQueueToken(head, pp->tu->scratch_arena, &it.tok, hideset, this_loc);
+									C_PpNextToken(&it);
 								}
 							}
 						}
@@ -741,32 +1304,20 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 							// NOTE(ljre): Copy all leading tokens of left argument, excluding last
 							while (count_left --> 1)
 							{
-								C_PreprocTokenList* tok = Arena_PushStructData(pp->tu->scratch_arena, C_PreprocTokenList, it_left);
-								tok->next = NULL;
-								tok->hideset = hideset;
-								tok->expanded_from = this_loc;
-								
-								*head = tok;
-								head = &(*head)->next;
-								it_left = it_left->next;
+								head = C_PpQueueToken(head, pp->tu->scratch_arena, &it_left.tok, hideset, this_loc);
+								C_PpNextToken(&it_left);
 							}
 							
 							// NOTE(ljre): Concat tokens
-							head = C_PpConcatTokens(pp, &it_left->tok, &it_right->tok, head, hideset, this_loc);
-							it_right = it_right->next;
+							head = C_PpConcatTokens(pp, &it_left.tok, &it_right.tok, head, hideset, this_loc);
+							C_PpNextToken(&it_right);
 							--count_right;
 							
 							// NOTE(ljre): Copy all trailling tokens of right argument
 							while (count_right --> 0)
 							{
-								C_PreprocTokenList* tok = Arena_PushStructData(pp->tu->scratch_arena, C_PreprocTokenList, it_right);
-								tok->next = NULL;
-								tok->hideset = hideset;
-								tok->expanded_from = this_loc;
-								
-								*head = tok;
-								head = &(*head)->next;
-								it_right = it_right->next;
+								head = C_PpQueueToken(head, pp->tu->scratch_arena, &it_right.tok, hideset, this_loc);
+								C_PpNextToken(&it_right);
 							}
 						}
 						
@@ -794,28 +1345,36 @@ C_PpExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, C_Macro* macro)
 		}
 	}
 	
-	rd->tok = rd->list->tok;
+	C_PpSyncToken(rd);
 	return result;
 }
 
-static bool
-C_PpTryToExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, uint32* out_added_token_count)
+// NOTE(ljre): Returns the macro that the identifier at 'rd' should be expanded as, if any.
+static C_Macro*
+C_PpFindMacroToExpand(C_PpContext* pp, C_PpTokenReader* rd)
 {
 	Assert(rd->tok.kind == C_TokenKind_Identifier);
 	
-	String name = rd->tok.as_string;
+	C_SymbolId symbol = rd->tok.symbol;
 	
-	for (C_PreprocHideset* hset = rd->list->hideset; hset; hset = hset->next)
-	{
-		if (String_Equals(hset->name, name))
-			return false;
-	}
+	if (C_PpHidesetContains(C_PpTokenHideset(rd), symbol))
+		return NULL;
 	
-	C_Macro* macro = C_PpFindMacro(pp, name);
+	C_Macro* macro = C_PpFindMacro(pp, symbol);
 	if (!macro)
-		return false;
+		return NULL;
 	
 	if (macro->is_func_like && C_PpPeekToken(rd).kind != C_TokenKind_LeftParen)
+		return NULL;
+	
+	return macro;
+}
+
+static bool
+C_PpTryToExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, uint32* out_added_token_count)
+{
+	C_Macro* macro = C_PpFindMacroToExpand(pp, rd);
+	if (!macro)
 		return false;
 	
 	uint32 added_token_count = C_PpExpandMacro(pp, rd, macro);
@@ -825,103 +1384,464 @@ C_PpTryToExpandMacro(C_PpContext* pp, C_PpTokenReader* rd, uint32* out_added_tok
 	return true;
 }
 
-//~ NOTE(ljre): File handling
-static C_LoadedFile*
-C_PpTryToLoadFile(C_PpContext* pp, String path)
+// NOTE(ljre): Same as C_PpTryToExpandMacro, but plain macros are written to the output right away
+//             instead of being queued in front of 'rd' only to be read back one by one.
+static bool
+C_PpTryToExpandMacroToOutput(C_PpContext* pp, C_PpTokenReader* rd)
 {
-	C_HashMapChunk* map = pp->tu->files_hashmap;
-	uint64 hash = Hash_StringHash(path);
+	C_Macro* macro = C_PpFindMacroToExpand(pp, rd);
+	if (!macro)
+		return false;
+	
+	if (!macro->is_plain)
+	{
+		C_PpExpandMacro(pp, rd, macro);
+		return true;
+	}
+	
+	C_SourceLoc this_loc = C_PpPushLocExpansion(pp, C_PpTokenLoc(pp, rd), macro->symbol);
+	
+	C_PreprocTokenList* it = macro->replacement;
+	for (uint32 i = 0; i < macro->replacement_count; ++i, it = it->next)
+		C_PpWriteToken(pp, &it->tok, this_loc);
+	
+	C_PpNextToken(rd);
+	return true;
+}
+
+//~ NOTE(ljre): Scanning directives
+// NOTE(ljre): Returns the index of the '#' of the #elif, #else or #endif that ends the group containing
+//             'index', or 'array->size' if there's none.
+//
+//             Only the 'kinds' array is scanned: we look for '#' tokens that begin a line and check the
+//             symbol right after them, so nothing inside the group is ever decoded.
+static uint32
+C_PpScanToGroupEnd(const C_PreprocTokenArray* array, uint32 index)
+{
+	uint32 i = index;
+	uint32 depth = 0;
+	
+	for (; i < array->size; ++i)
+	{
+		const uint8* found = Mem_FindByte(array->kinds + i, C_TokenKind_Hashtag, array->size - i);
+		if (!found)
+			return array->size;
+		
+		i = (uint32)(found - array->kinds);
+		
+		if (i == 0 || array->kinds[i-1] != C_TokenKind_NewLine)
+			continue;
+		if (i+1 >= array->size || array->kinds[i+1] != C_TokenKind_Identifier)
+			continue;
+		
+		C_SymbolId directive = array->symbols[i+1];
+		
+		if (directive == C_TokenKind_If || directive == C_KnownSymbol_Ifdef || directive == C_KnownSymbol_Ifndef)
+			++depth;
+		else if (depth > 0)
+			depth -= (directive == C_KnownSymbol_Endif);
+		else if (directive == C_KnownSymbol_Endif || directive == C_KnownSymbol_Elif || directive == C_TokenKind_Else)
+			return i;
+	}
+	
+	return array->size;
+}
+
+// NOTE(ljre): Returns X if the file is nothing but '#ifndef X' ... '#endif' (ignoring line breaks), and 0
+//             otherwise. Since that only depends on the tokens, it's done once when the file is loaded.
+static C_SymbolId
+C_PpFindIncludeGuard(const C_PreprocTokenArray* array)
+{
+	const uint8* kinds = array->kinds;
+	uint32 size = array->size;
+	uint32 i = 0;
+	
+	while (i < size && kinds[i] == C_TokenKind_NewLine)
+		++i;
+	
+	if (i+3 >= size ||
+		kinds[i] != C_TokenKind_Hashtag ||
+		kinds[i+1] != C_TokenKind_Identifier || array->symbols[i+1] != C_KnownSymbol_Ifndef ||
+		kinds[i+2] != C_TokenKind_Identifier ||
+		kinds[i+3] != C_TokenKind_NewLine)
+	{
+		return 0;
+	}
+	
+	C_SymbolId guard = array->symbols[i+2];
+	uint32 end = C_PpScanToGroupEnd(array, i+3);
+	
+	if (end == size || array->symbols[end+1] != C_KnownSymbol_Endif)
+		return 0;
+	
+	// NOTE(ljre): Anything after the '#endif' line means the file isn't fully guarded.
+	i = end + 2;
+	while (i < size && kinds[i] != C_TokenKind_NewLine)
+		++i;
+	while (i < size && kinds[i] == C_TokenKind_NewLine)
+		++i;
+	
+	return (i == size) ? guard : 0;
+}
+
+//~ NOTE(ljre): File handling
+static C_FileCache*
+C_CreateFileCache(Arena* arena, uint32 log2cap)
+{
+	C_FileCache* cache = Arena_PushStruct(arena, C_FileCache);
+	cache->log2cap = log2cap;
+	cache->slots = Arena_PushArray(arena, C_LoadedFile*, 1 << log2cap);
+	cache->id_slots = Arena_PushArray(arena, C_LoadedFile*, 1 << log2cap);
+	
+	return cache;
+}
+
+static C_IncludeCache*
+C_CreateIncludeCache(Arena* arena, uint32 log2cap)
+{
+	C_IncludeCache* cache = Arena_PushStruct(arena, C_IncludeCache);
+	cache->log2cap = log2cap;
+	cache->entries = Arena_PushArray(arena, C_IncludeEntry*, 1 << log2cap);
+	cache->dirs = Arena_PushArray(arena, C_DirListing*, 1 << log2cap);
+	
+	return cache;
+}
+
+// NOTE(ljre): FNV-1a of the ASCII lowercase name, so it also works for case-insensitive file systems.
+//             Never 0.
+static uint64
+C_PpHashFileName(String name)
+{
+	uint64 result = 14695981039346656037u;
+	
+	for (uintsize i = 0; i < name.size; ++i)
+	{
+		uint8 ch = name.data[i];
+		if (ch >= 'A' && ch <= 'Z')
+			ch += 'a' - 'A';
+		
+		result ^= ch;
+		result *= 1099511628211u;
+	}
+	
+	return result ? result : 1;
+}
+
+static bool
+C_PpDirListingHas(const C_DirListing* listing, String name)
+{
+	uint64 hash = C_PpHashFileName(name);
 	int32 index = (int32)hash;
 	
 	for (;;)
 	{
-		index = Hash_Msi(map->log2cap, hash, index);
-		C_LoadedFile** pfile = (C_LoadedFile**)map->memory + index;
+		index = Hash_Msi(listing->log2cap, hash, index);
+		uint64 slot = listing->name_hashes[index];
+		
+		if (!slot)
+			return false;
+		if (slot == hash)
+			return true;
+	}
+}
+
+static C_DirListing*
+C_PpListDirectory(C_PpContext* pp, String path, uint64 path_hash)
+{
+	Arena* arena = pp->tu->cache_arena;
+	
+	C_DirListing* listing = Arena_PushStruct(arena, C_DirListing);
+	listing->path_hash = path_hash;
+	listing->path = Arena_PushString(arena, path);
+	
+	for Arena_TempScope(pp->tu->scratch_arena)
+	{
+		String* names;
+		uintsize count;
+		
+		// NOTE(ljre): A directory we can't list (or that doesn't exist) is just empty.
+		if (!OS_ListDirectory(path, &names, &count, pp->tu->scratch_arena, NULL))
+			count = 0;
+		
+		uint32 log2cap = 4;
+		while ((1u << log2cap) < count * 2)
+			++log2cap;
 		
-		if (*pfile)
+		listing->log2cap = log2cap;
+		listing->name_hashes = Arena_PushArray(arena, uint64, 1u << log2cap);
+		
+		for (uintsize i = 0; i < count; ++i)
 		{
-			C_LoadedFile* file = *pfile;
+			uint64 hash = C_PpHashFileName(names[i]);
+			int32 index = (int32)hash;
 			
-			if (file->path_hash == hash && String_Equals(file->path, path))
-			{
-				if (!file->tokens)
-					return NULL;
-				
-				return file;
-			}
+			do
+				index = Hash_Msi(log2cap, hash, index);
+			while (listing->name_hashes[index] && listing->name_hashes[index] != hash);
 			
-			if (file->path.size != 0)
-				continue;
+			listing->name_hashes[index] = hash;
 		}
-		
-		if (map->size >= 1u << map->log2cap)
+	}
+	
+	return listing;
+}
+
+static C_DirListing*
+C_PpGetDirListing(C_PpContext* pp, String path)
+{
+	C_IncludeCache* cache = pp->tu->include_cache;
+	uint64 hash = Hash_StringHash(path);
+	int32 index = Hash_Msi(cache->log2cap, hash, (int32)hash);
+	
+	C_DirListing* new_listing = NULL;
+	C_DirListing* listing = Atomic_LoadPtr((void* volatile*)&cache->dirs[index]);
+	
+	for (;;)
+	{
+		if (listing)
 		{
-			if (!map->next)
-			{
-				uint32 cap = Min(map->log2cap + 1, 20);
-				map->next = C_AllocHashMapChunk(pp->tu->stage_arena, cap, sizeof(C_LoadedFile*));
-			}
+			if (listing->path_hash == hash && String_Equals(listing->path, path))
+				return listing;
 			
-			map = map->next;
-			index = (int32)hash;
+			index = Hash_Msi(cache->log2cap, hash, index);
+			listing = Atomic_LoadPtr((void* volatile*)&cache->dirs[index]);
 			continue;
 		}
 		
-		String contents = { 0 };
-		if (!OS_ReadWholeFile(path, &contents, pp->tu->stage_arena, NULL))
-			return NULL;
+		if (!new_listing)
+			new_listing = C_PpListDirectory(pp, path, hash);
+		
+		if (Atomic_Load32(&cache->dir_count) >= 1u << (cache->log2cap-1))
+			return new_listing;
+		
+		listing = Atomic_CompareExchangePtr((void* volatile*)&cache->dirs[index], NULL, new_listing);
+		if (!listing)
+		{
+			Atomic_FetchAdd32(&cache->dir_count, 1);
+			return new_listing;
+		}
+		
+		// NOTE(ljre): Lost the race for this slot. Ours is leaked, which is fine since it's so rare.
+	}
+}
+
+// NOTE(ljre): False only if 'dir/name' surely doesn't exist. Every directory on the way is listed once per
+//             process, so looking for a header in the wrong include dir doesn't touch the file system.
+static bool
+C_PpPathMightExist(C_PpContext* pp, String dir, String name)
+{
+	Arena_Savepoint scratch_save = Arena_Save(pp->tu->scratch_arena);
+	
+	String folder = dir;
+	uintsize begin = 0;
+	bool result = true;
+	
+	for (uintsize i = 0; result && i <= name.size; ++i)
+	{
+		if (i < name.size && name.data[i] != '/' && name.data[i] != '\\')
+			continue;
 		
-		C_LoadedFile* file = Arena_PushStruct(pp->tu->stage_arena, C_LoadedFile);
-		*pfile = file;
+		String component = StrMake(i - begin, name.data + begin);
+		begin = i + 1;
 		
-		file->path_hash = hash;
-		file->path = Arena_PushString(pp->tu->tree_arena, path);
-		file->contents = contents;
+		// NOTE(ljre): Can't tell without resolving the path, so just let the caller try it.
+		if (component.size == 0 || String_Equals(component, Str(".")) || String_Equals(component, Str("..")))
+			break;
 		
-		C_Error error = { 0 };
-		C_PreprocTokenList* tokens = C_TokenizeForPreproc(pp->tu, pp->tu->stage_arena, contents, &error);
+		result = C_PpDirListingHas(C_PpGetDirListing(pp, folder), component);
 		
-		if (!C_IsOk(&error))
-			return NULL;
+		if (i < name.size)
+			folder = Arena_Printf(pp->tu->scratch_arena, "%S/%S", folder, component);
+	}
+	
+	Arena_Restore(scratch_save);
+	return result;
+}
+
+static inline uint64
+C_PpHashFileId(uint64 device, uint64 inode)
+{ return Hash_IntHash64(inode ^ Hash_IntHash64(device)); }
+
+static C_LoadedFile*
+C_PpFindFileById(C_FileCache* cache, uint64 device, uint64 inode)
+{
+	if (!device && !inode)
+		return NULL;
+	
+	uint64 hash = C_PpHashFileId(device, inode);
+	int32 index = Hash_Msi(cache->log2cap, hash, (int32)hash);
+	C_LoadedFile* file = Atomic_LoadPtr((void* volatile*)&cache->id_slots[index]);
+	
+	while (file)
+	{
+		if (file->device == device && file->inode == inode)
+			return file;
 		
-		file->tokens = tokens;
-		return file;
+		index = Hash_Msi(cache->log2cap, hash, index);
+		file = Atomic_LoadPtr((void* volatile*)&cache->id_slots[index]);
 	}
 	
 	return NULL;
 }
 
+static void
+C_PpPublishFileId(C_FileCache* cache, C_LoadedFile* new_file)
+{
+	if (!new_file->device && !new_file->inode)
+		return;
+	if (Atomic_Load32(&cache->id_count) >= 1u << (cache->log2cap-1))
+		return;
+	
+	uint64 hash = C_PpHashFileId(new_file->device, new_file->inode);
+	int32 index = (int32)hash;
+	
+	for (;;)
+	{
+		index = Hash_Msi(cache->log2cap, hash, index);
+		C_LoadedFile* file = Atomic_CompareExchangePtr((void* volatile*)&cache->id_slots[index], NULL, new_file);
+		
+		if (!file)
+		{
+			Atomic_FetchAdd32(&cache->id_count, 1);
+			break;
+		}
+		
+		// NOTE(ljre): Another path to the same file got there first. Either one is fine.
+		if (file->device == new_file->device && file->inode == new_file->inode)
+			break;
+	}
+}
+
 static C_LoadedFile*
-C_TryToIncludeFile(C_PpContext* pp, String path, bool relative)
+C_PpTryToLoadFile(C_PpContext* pp, String path, C_LoadedFileFlags flags)
 {
-	if (relative)
+	C_FileCache* cache = pp->tu->file_cache;
+	Arena* arena = pp->tu->cache_arena;
+	uint64 hash = Hash_StringHash(path);
+	int32 index = (int32)hash;
+	
+	uint8* arena_end = Arena_End(arena);
+	C_LoadedFile* new_file = NULL;
+	C_LoadedFile* same_file = NULL;
+	
+	index = Hash_Msi(cache->log2cap, hash, index);
+	C_LoadedFile* file = Atomic_LoadPtr((void* volatile*)&cache->slots[index]);
+	
+	for (;;)
 	{
-		C_LoadedFile* file = NULL;
+		if (file)
+		{
+			if (file->path_hash == hash && String_Equals(file->path, path))
+			{
+				// NOTE(ljre): Someone else loaded it first (or it was already there).
+				if (new_file)
+					Arena_Pop(arena, arena_end);
+				
+				if (!file->tokens)
+					return NULL;
+				
+				return file;
+			}
+			
+			index = Hash_Msi(cache->log2cap, hash, index);
+			file = Atomic_LoadPtr((void* volatile*)&cache->slots[index]);
+			continue;
+		}
 		
-		for Arena_TempScope(pp->tu->scratch_arena)
+		if (!new_file)
 		{
-			String curr_folder;
-			OS_SplitPath(pp->current_file->path, &curr_folder, NULL);
+			OS_FileInfo info = { 0 };
+			OS_GetFileInfo(path, &info, pp->tu->scratch_arena, NULL);
 			
-			String fullpath = Arena_Printf(pp->tu->scratch_arena, "%S/%S", curr_folder, path);
-			file = C_PpTryToLoadFile(pp, fullpath);
+			// NOTE(ljre): Same file through a different path, so there's nothing to read nor tokenize.
+			same_file = C_PpFindFileById(cache, info.device, info.inode);
+			
+			String contents = { 0 };
+			if (same_file)
+				contents = same_file->contents;
+			else if (!OS_ReadWholeFile(path, &contents, arena, NULL))
+				return NULL;
+			
+			new_file = Arena_PushStruct(arena, C_LoadedFile);
+			new_file->path_hash = hash;
+			new_file->flags = flags;
+			new_file->path = Arena_PushString(arena, path);
+			new_file->contents = contents;
+			new_file->device = info.device;
+			new_file->inode = info.inode;
+			
+			if (same_file)
+			{
+				new_file->tokens = same_file->tokens;
+				new_file->include_guard = same_file->include_guard;
+			}
+			else
+			{
+				// NOTE(ljre): Only system headers go through the token cache. They're the ones shared by
+				//             every TU and the least likely to change between runs.
+				bool use_token_cache = (flags & C_LoadedFileFlags_SystemFile) && pp->tu->options->token_cache_dir.size > 0;
+				
+				if (use_token_cache)
+					new_file->tokens = C_LoadTokenCache(pp->tu, arena, path, hash, contents);
+				
+				if (!new_file->tokens)
+				{
+					C_Error error = { 0 };
+					C_PreprocTokenArray* tokens = C_TokenizeForPreproc(pp->tu, arena, contents, &error);
+					
+					if (C_IsOk(&error))
+					{
+						new_file->tokens = tokens;
+						
+						if (use_token_cache && tokens)
+							C_SaveTokenCache(pp->tu, path, hash, tokens);
+					}
+				}
+				
+				if (new_file->tokens)
+					new_file->include_guard = C_PpFindIncludeGuard(new_file->tokens);
+			}
 		}
 		
-		if (file)
-			return file;
+		if (Atomic_Load32(&cache->count) >= 1u << (cache->log2cap-1))
+			break;
+		
+		file = Atomic_CompareExchangePtr((void* volatile*)&cache->slots[index], NULL, new_file);
+		if (!file)
+		{
+			Atomic_FetchAdd32(&cache->count, 1);
+			
+			if (!same_file)
+				C_PpPublishFileId(cache, new_file);
+			
+			break;
+		}
+		
+		// NOTE(ljre): Lost the race for this slot. 'file' is now whatever the winner put there, so check it.
 	}
 	
-	// TODO(ljre): Cache non-relative includes by name so we don't have to try every possible path for it.
+	if (!new_file->tokens)
+		return NULL;
+	
+	return new_file;
+}
+
+static C_LoadedFile*
+C_PpSearchIncludeDirs(C_PpContext* pp, String path)
+{
 	uintsize count = pp->tu->options->include_dirs_count;
 	const String* dirs = pp->tu->options->include_dirs;
 	C_LoadedFile* file = NULL;
 	
 	for (intsize i = 0; i < count; ++i)
 	{
+		if (!C_PpPathMightExist(pp, dirs[i], path))
+			continue;
+		
 		for Arena_TempScope(pp->tu->scratch_arena)
 		{
 			String fullpath = Arena_Printf(pp->tu->scratch_arena, "%S/%S", dirs[i], path);
-			file = C_PpTryToLoadFile(pp, fullpath);
+			file = C_PpTryToLoadFile(pp, fullpath, C_LoadedFileFlags_SystemFile);
 		}
 		
 		if (file)
@@ -931,68 +1851,237 @@ C_TryToIncludeFile(C_PpContext* pp, String path, bool relative)
 	return file;
 }
 
-//~ NOTE(ljre): Preproc directives
-static C_Macro*
-C_PpDefineMacro(C_PpContext* pp, C_PpTokenReader* rd)
+static C_LoadedFile*
+C_TryToIncludeFile(C_PpContext* pp, String path, bool relative)
 {
-	Assert(rd->tok.kind);
-	if (rd->tok.kind != C_TokenKind_Identifier)
-		C_PpPushError(pp, rd, "expected identifier in macro definition.");
-	
-	C_SourceLocation* loc = &(C_SourceLocation) {
-		.filepath = pp->current_file->path,
-		.leading_spaces = rd->tok.leading_spaces,
-		.line = rd->tok.line,
-		.col = rd->tok.col,
-	};
-	
-	loc = Arena_PushStructData(pp->tu->loc_arena, C_SourceLocation, loc);
-	
-	C_Macro macro = {
-		.name = rd->tok.as_string,
-		.is_func_like = false,
-		.has_va_args = false,
-		.param_count = 0,
-		.definition_loc = loc,
-	};
-	
-	C_PpNextToken(rd);
-	
-	// NOTE(ljre): If function-like macro, compile it to C_MacroInst array.
-	if (rd->tok.kind == C_TokenKind_LeftParen && rd->tok.leading_spaces == 0)
+	if (relative)
 	{
-		C_PpNextToken(rd);
-		macro.is_func_like = true;
+		C_LoadedFile* file = NULL;
+		String curr_folder;
+		OS_SplitPath(pp->current_file->path, &curr_folder, NULL);
 		
-		int32 param_count = 0;
-		String* params = Arena_EndAligned(pp->tu->scratch_arena, alignof(String));
+		// NOTE(ljre): A bare file name like 'a.c' has no folder at all, so its includes are relative to
+		//             the working directory, and the path is used as it is. A file at the root, like '/a.c',
+		//             has an empty folder instead.
+		bool has_folder = (curr_folder.data != NULL);
+		String listed_folder = curr_folder;
 		
-		while (rd->tok.kind && rd->tok.kind != C_TokenKind_RightParen)
+		if (!has_folder)
+			listed_folder = Str(".");
+		else if (curr_folder.size == 0)
+			listed_folder = StrMake(1, pp->current_file->path.data);
+		
+		if (C_PpPathMightExist(pp, listed_folder, path))
 		{
-			if (rd->tok.kind == C_TokenKind_Identifier)
+			for Arena_TempScope(pp->tu->scratch_arena)
 			{
-				Arena_PushStructData(pp->tu->scratch_arena, String, &rd->tok.as_string);
-				++param_count;
+				String fullpath = path;
+				if (has_folder)
+					fullpath = Arena_Printf(pp->tu->scratch_arena, "%S/%S", curr_folder, path);
 				
-				C_PpNextToken(rd);
+				file = C_PpTryToLoadFile(pp, fullpath, C_LoadedFileFlags_RelativeInclude);
 			}
-			else if (rd->tok.kind == C_TokenKind_VarArgs)
+		}
+		
+		if (file)
+			return file;
+	}
+	
+	// NOTE(ljre): Where a name is found in the include dirs is the same for every TU, so it's cached,
+	//             even if it's not found anywhere.
+	C_IncludeCache* cache = pp->tu->include_cache;
+	uint64 hash = Hash_StringHash(path);
+	int32 index = Hash_Msi(cache->log2cap, hash, (int32)hash);
+	C_IncludeEntry* entry = Atomic_LoadPtr((void* volatile*)&cache->entries[index]);
+	
+	while (entry)
+	{
+		if (entry->name_hash == hash && String_Equals(entry->name, path))
+			return entry->file;
+		
+		index = Hash_Msi(cache->log2cap, hash, index);
+		entry = Atomic_LoadPtr((void* volatile*)&cache->entries[index]);
+	}
+	
+	C_LoadedFile* file = C_PpSearchIncludeDirs(pp, path);
+	
+	if (Atomic_Load32(&cache->entry_count) < 1u << (cache->log2cap-1))
+	{
+		C_IncludeEntry* new_entry = Arena_PushStruct(pp->tu->cache_arena, C_IncludeEntry);
+		new_entry->name_hash = hash;
+		new_entry->name = Arena_PushString(pp->tu->cache_arena, path);
+		new_entry->file = file;
+		
+		for (;;)
+		{
+			entry = Atomic_CompareExchangePtr((void* volatile*)&cache->entries[index], NULL, new_entry);
+			
+			if (!entry)
 			{
-				Arena_PushStructData(pp->tu->scratch_arena, String, &Str("__VA_ARGS__"));
-				++param_count;
-				macro.has_va_args = true;
-				
-				C_PpNextToken(rd);
+				Atomic_FetchAdd32(&cache->entry_count, 1);
 				break;
 			}
 			
-			if (!C_PpTryEatToken(rd, C_TokenKind_Comma))
+			// NOTE(ljre): Someone else resolved the same name first. They got the same result.
+			if (entry->name_hash == hash && String_Equals(entry->name, path))
 				break;
+			
+			index = Hash_Msi(cache->log2cap, hash, index);
 		}
-		
-		C_PpEatToken(pp, rd, C_TokenKind_RightParen);
-		
-		macro.param_count = param_count;
+	}
+	
+	return file;
+}
+
+// NOTE(ljre): Two paths to the same file are the same file. Without an identity from the OS, we can only
+//             compare the entries themselves.
+static inline bool
+C_PpIsSameFile(const C_LoadedFile* left, const C_LoadedFile* right)
+{
+	if (!left->device && !left->inode)
+		return left == right;
+	
+	return left->device == right->device && left->inode == right->inode;
+}
+
+static inline uint64
+C_PpHashFileIdentity(const C_LoadedFile* file)
+{
+	if (!file->device && !file->inode)
+		return Hash_IntHash64((uint64)(uintptr)file);
+	
+	return C_PpHashFileId(file->device, file->inode);
+}
+
+// NOTE(ljre): Returns the slot where 'file' is (or would be) in the set of '#pragma once' files.
+static C_LoadedFile**
+C_PpFindOnceSlot(C_PpContext* pp, const C_LoadedFile* file)
+{
+	uint64 hash = C_PpHashFileIdentity(file);
+	int32 index = (int32)hash;
+	
+	for (;;)
+	{
+		index = Hash_Msi(pp->once_files_log2cap, hash, index);
+		C_LoadedFile** slot = &pp->once_files[index];
+		
+		if (!*slot || C_PpIsSameFile(*slot, file))
+			return slot;
+	}
+}
+
+static bool
+C_PpIsIncludedOnce(C_PpContext* pp, const C_LoadedFile* file)
+{
+	if (pp->once_files_count == 0)
+		return false;
+	
+	return *C_PpFindOnceSlot(pp, file) != NULL;
+}
+
+static void
+C_PpMarkIncludedOnce(C_PpContext* pp, C_LoadedFile* file)
+{
+	if (pp->once_files_count >= (1u << pp->once_files_log2cap) / 2)
+	{
+		uint32 old_cap = 1u << pp->once_files_log2cap;
+		C_LoadedFile** old_files = pp->once_files;
+		
+		pp->once_files_log2cap += 1;
+		pp->once_files = Arena_PushArray(pp->tu->stage_arena, C_LoadedFile*, 1u << pp->once_files_log2cap);
+		
+		for (uint32 i = 0; i < old_cap; ++i)
+		{
+			if (old_files[i])
+				*C_PpFindOnceSlot(pp, old_files[i]) = old_files[i];
+		}
+	}
+	
+	C_LoadedFile** slot = C_PpFindOnceSlot(pp, file);
+	
+	if (!*slot)
+	{
+		*slot = file;
+		++pp->once_files_count;
+	}
+}
+
+//~ NOTE(ljre): Preproc directives
+// NOTE(ljre): Copies the rest of the line to a list owned by the macro, since we can't point into a
+//             file's token array from a C_PreprocTokenList. 'rd' is left at the end of the line.
+static C_PpTokenReader
+C_PpCopyMacroBody(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	C_PreprocTokenList* body = NULL;
+	C_PreprocTokenList** head = &body;
+	
+	while (rd->tok.kind && rd->tok.kind != C_TokenKind_NewLine)
+	{
+		head = C_PpQueueToken(head, pp->tu->stage_arena, &rd->tok, NULL, 0);
+		C_PpNextToken(rd);
+	}
+	
+	return C_PpMakeTokenReader(body, NULL, 0);
+}
+
+static C_Macro*
+C_PpDefineMacro(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	Assert(rd->tok.kind);
+	if (rd->tok.kind != C_TokenKind_Identifier)
+		C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpExpectedMacroName, 0);
+	
+	C_SourceLoc loc = C_PpTokenLoc(pp, rd);
+	
+	C_Macro macro = {
+		.name = rd->tok.as_string,
+		.symbol = rd->tok.symbol,
+		.is_func_like = false,
+		.has_va_args = false,
+		.param_count = 0,
+		.definition_loc = loc,
+	};
+	
+	C_PpNextToken(rd);
+	
+	// NOTE(ljre): If function-like macro, compile it to C_MacroInst array.
+	if (rd->tok.kind == C_TokenKind_LeftParen && rd->tok.leading_spaces == 0)
+	{
+		C_PpNextToken(rd);
+		macro.is_func_like = true;
+		
+		int32 param_count = 0;
+		C_SymbolId* params = Arena_EndAligned(pp->tu->scratch_arena, alignof(C_SymbolId));
+		
+		while (rd->tok.kind && rd->tok.kind != C_TokenKind_RightParen)
+		{
+			if (rd->tok.kind == C_TokenKind_Identifier)
+			{
+				Arena_PushStructData(pp->tu->scratch_arena, C_SymbolId, &rd->tok.symbol);
+				++param_count;
+				
+				C_PpNextToken(rd);
+			}
+			else if (rd->tok.kind == C_TokenKind_VarArgs)
+			{
+				Arena_PushStructData(pp->tu->scratch_arena, C_SymbolId, &(C_SymbolId) { C_KnownSymbol_VaArgs });
+				++param_count;
+				macro.has_va_args = true;
+				
+				C_PpNextToken(rd);
+				break;
+			}
+			
+			if (!C_PpTryEatToken(rd, C_TokenKind_Comma))
+				break;
+		}
+		
+		C_PpEatToken(pp, rd, C_TokenKind_RightParen);
+		
+		C_PpTokenReader body_rd = C_PpCopyMacroBody(pp, rd);
+		rd = &body_rd;
+		
+		macro.param_count = param_count;
 		macro.insts = Arena_EndAligned(pp->tu->stage_arena, alignof(C_MacroInst));
 		
 		int32 running_copy = 0;
@@ -1008,13 +2097,13 @@ C_PpDefineMacro(C_PpContext* pp, C_PpTokenReader* rd)
 				uint32 leading_spaces = rd->tok.leading_spaces;
 				int32 param_index = -1;
 				
-				if (rd->tok.kind == C_TokenKind_Identifier && (param_index = C_PpFindStringInArray(params, param_count, rd->tok.as_string)) != -1)
+				if (rd->tok.kind == C_TokenKind_Identifier && (param_index = C_PpFindSymbolInArray(params, param_count, rd->tok.symbol)) != -1)
 				{
 					C_PpNextToken(rd); // eat this token
 					C_PpNextToken(rd); // eat ##
 					
 					int32 param2_index = -1;
-					if (rd->tok.kind == C_TokenKind_Identifier && (param2_index = C_PpFindStringInArray(params, param_count, rd->tok.as_string)) != -1)
+					if (rd->tok.kind == C_TokenKind_Identifier && (param2_index = C_PpFindSymbolInArray(params, param_count, rd->tok.symbol)) != -1)
 					{
 						running_copy = 0;
 						last_inst = Arena_PushStruct(pp->tu->stage_arena, C_MacroInst);
@@ -1045,7 +2134,7 @@ C_PpDefineMacro(C_PpContext* pp, C_PpTokenReader* rd)
 					C_PpNextToken(rd); // eat this token
 					C_PpNextToken(rd); // eat ##
 					
-					if (rd->tok.kind == C_TokenKind_Identifier && (param_index = C_PpFindStringInArray(params, param_count, rd->tok.as_string)) != -1)
+					if (rd->tok.kind == C_TokenKind_Identifier && (param_index = C_PpFindSymbolInArray(params, param_count, rd->tok.symbol)) != -1)
 					{
 						running_copy = 0;
 						last_inst = Arena_PushStruct(pp->tu->stage_arena, C_MacroInst);
@@ -1059,7 +2148,7 @@ C_PpDefineMacro(C_PpContext* pp, C_PpTokenReader* rd)
 					}
 					else
 					{
-						C_PpPushError(pp, rd, "expected a macro parameter.");
+						C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpExpectedMacroParam, 0);
 					}
 				}
 			}
@@ -1070,16 +2159,15 @@ C_PpDefineMacro(C_PpContext* pp, C_PpTokenReader* rd)
 				
 				if (rd->tok.kind != C_TokenKind_Identifier)
 				{
-					C_PpPushError(pp, rd, "expected a macro parameter.");
+					C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpExpectedMacroParam, 0);
 					continue;
 				}
 				
-				String name = rd->tok.as_string;
-				int32 param_index = C_PpFindStringInArray(params, param_count, name);
+				int32 param_index = C_PpFindSymbolInArray(params, param_count, rd->tok.symbol);
 				
 				if (param_index == -1)
 				{
-					C_PpPushError(pp, rd, "expected a macro parameter.");
+					C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpExpectedMacroParam, 0);
 					continue;
 				}
 				
@@ -1095,8 +2183,7 @@ C_PpDefineMacro(C_PpContext* pp, C_PpTokenReader* rd)
 			else if (rd->tok.kind == C_TokenKind_Identifier)
 			{
 				// NOTE(ljre): Handle argument expansion
-				String name = rd->tok.as_string;
-				int32 param_index = C_PpFindStringInArray(params, param_count, name);
+				int32 param_index = C_PpFindSymbolInArray(params, param_count, rd->tok.symbol);
 				
 				if (param_index != -1)
 				{
@@ -1127,124 +2214,788 @@ C_PpDefineMacro(C_PpContext* pp, C_PpTokenReader* rd)
 	}
 	else
 	{
-		// NOTE(ljre): Take replacement
-		macro.replacement = rd->list;
-		while (rd->tok.kind && rd->tok.kind != C_TokenKind_NewLine)
-		{
-			++macro.replacement_count;
-			C_PpNextToken(rd);
-		}
+		// NOTE(ljre): Take replacement
+		C_PpTokenReader body_rd = C_PpCopyMacroBody(pp, rd);
+		rd = &body_rd;
+		
+		macro.replacement = rd->list;
+		macro.is_plain = true;
+		
+		while (rd->tok.kind && rd->tok.kind != C_TokenKind_NewLine)
+		{
+			if (rd->tok.kind == C_TokenKind_Identifier)
+				macro.is_plain = false;
+			
+			++macro.replacement_count;
+			C_PpNextToken(rd);
+		}
+	}
+	
+	return C_PpInsertMacroToHashmap(pp, &macro);
+}
+
+static bool
+C_PpUndefineMacro(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	if (rd->tok.kind != C_TokenKind_Identifier)
+	{
+		C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpExpectedUndefName, 0);
+		return false;
+	}
+	
+	return C_PpRemoveMacro(pp, rd->tok.symbol);
+}
+
+static void
+C_PpInclude(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	C_PreprocToken peek = C_PpPeekToken(rd);
+	C_LoadedFile* file = NULL;
+	String include_name = StrNull;
+	C_SourceLoc loc = C_PpTokenLoc(pp, rd);
+	
+	for Arena_TempScope(pp->tu->scratch_arena)
+	{
+		if (rd->tok.kind == C_TokenKind_StringLiteral && (!peek.kind || peek.kind == C_TokenKind_NewLine))
+		{
+			include_name = C_PpUnstringify(pp->tu->scratch_arena, rd->tok.as_string);
+			file = C_TryToIncludeFile(pp, include_name, true);
+		}
+		else if (rd->tok.kind == C_TokenKind_LThan)
+		{
+			C_PpNextToken(rd);
+			
+			C_PpTokenReader first = *rd;
+			uint32 count = 0;
+			bool error = false;
+			
+			while (rd->tok.kind && rd->tok.kind != C_TokenKind_GThan)
+			{
+				if (rd->tok.kind == C_TokenKind_NewLine)
+				{
+					error = true;
+					C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpUnterminatedIncludeName, 0);
+					break;
+				}
+				
+				++count;
+				C_PpNextToken(rd);
+			}
+			
+			if (!error)
+			{
+				// NOTE(ljre): The file name is the spelling of every token between the '<' and '>'.
+				uint8* const begin = Arena_End(pp->tu->scratch_arena);
+				
+				C_PpTokenReader it = first;
+				
+				for (uint32 i = 0; i < count; ++i, C_PpNextToken(&it))
+				{
+					if (i > 0 && it.tok.leading_spaces > 0)
+						Mem_Set(Arena_PushDirtyAligned(pp->tu->scratch_arena, it.tok.leading_spaces, 1), ' ', it.tok.leading_spaces);
+					
+					Arena_PushString(pp->tu->scratch_arena, it.tok.as_string);
+				}
+				
+				uint8* const end = Arena_End(pp->tu->scratch_arena);
+				
+				include_name = StrRange(begin, end);
+				file = C_TryToIncludeFile(pp, include_name, false);
+			}
+		}
+		else
+		{
+			// TODO: SLOW PATH
+			Assert(false);
+		}
+		
+		// NOTE(ljre): 'include_name' lives in the scratch arena, so report it before leaving this scope.
+		if (!file)
+			C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpCouldNotInclude, 1, include_name);
+	}
+	
+	if (file)
+	{
+		// NOTE(ljre): Once the guard macro is defined, including the file again would produce nothing.
+		bool is_guarded = file->include_guard && C_PpIsMacroDefined(pp, file->include_guard);
+		
+		if (!is_guarded && !C_PpIsIncludedOnce(pp, file))
+		{
+			C_PpPreprocessFile(pp, file, loc);
+		}
+	}
+}
+
+//~ NOTE(ljre): Conditional directives
+// NOTE(ljre): Skips every token until the #elif, #else or #endif that ends the current group, and leaves
+//             'rd' at the line break right before it.
+static void
+C_PpSkipGroup(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	while (rd->list)
+		C_PpNextToken(rd);
+	
+	uint32 index = C_PpScanToGroupEnd(rd->array, rd->index);
+	
+	rd->index = (index < rd->array->size) ? index-1 : index;
+	C_PpSyncToken(rd);
+}
+
+struct C_PpValue
+{
+	uint64 value;
+	bool is_unsigned;
+}
+typedef C_PpValue;
+
+struct C_PpEval
+{
+	C_PpContext* pp;
+	C_PreprocTokenList* head;
+	// NOTE(ljre): Errors at the end of the expression are reported here.
+	C_SourceLoc end_loc;
+	
+	// NOTE(ljre): Greater than 0 while evaluating the operand of a short-circuited operator, which
+	//             shouldn't report errors such as division by zero.
+	int32 unevaluated;
+	bool ok;
+}
+typedef C_PpEval;
+
+static C_PpValue C_PpEvalExpression(C_PpEval* ev);
+
+static inline C_TokenKind
+C_PpEvalPeek(C_PpEval* ev)
+{ return ev->head ? ev->head->tok.kind : C_TokenKind_Null; }
+
+static inline void
+C_PpEvalNext(C_PpEval* ev)
+{
+	if (ev->head)
+		ev->head = ev->head->next;
+}
+
+static void
+C_PpEvalError(C_PpEval* ev, const char* what)
+{
+	if (ev->unevaluated > 0)
+		return;
+	
+	if (ev->ok)
+	{
+		C_SourceLoc loc = ev->head ? ev->head->loc : ev->end_loc;
+		C_PushDiagnostic(ev->pp->tu, C_DiagnosticKind_PpBadExpression, loc, 1, StrMake(Mem_Strlen(what), what));
+	}
+	
+	ev->ok = false;
+}
+
+static C_PpValue
+C_PpEvalIntLiteral(C_PpEval* ev, const C_PreprocToken* tok)
+{
+	String str = tok->as_string;
+	
+	while (str.size > 0 && (str.data[str.size-1] == 'u' || str.data[str.size-1] == 'U' || str.data[str.size-1] == 'l' || str.data[str.size-1] == 'L'))
+		--str.size;
+	
+	int32 base = 10;
+	uintsize i = 0;
+	
+	if (str.size >= 2 && str.data[0] == '0' && (str.data[1] == 'x' || str.data[1] == 'X'))
+		base = 16, i = 2;
+	else if (str.size >= 2 && str.data[0] == '0' && (str.data[1] == 'b' || str.data[1] == 'B'))
+		base = 2, i = 2;
+	else if (str.size >= 2 && str.data[0] == '0')
+		base = 8, i = 1;
+	
+	uint8 digit_class = Char_DigitClassForBase(base);
+	uint64 value = 0;
+	bool overflow = false;
+	
+	for (; i < str.size; ++i)
+	{
+		uint8 ch = str.data[i];
+		if (!Char_Is(ch, digit_class))
+		{
+			C_PpEvalError(ev, "invalid integer constant");
+			break;
+		}
+		
+		uint32 digit = (ch >= 'a') ? ch - 'a' + 10 : (ch >= 'A') ? ch - 'A' + 10 : ch - '0';
+		
+		overflow |= (value > (UINT64_MAX - digit) / base);
+		value = value * base + digit;
+	}
+	
+	if (overflow)
+		C_PpEvalError(ev, "integer constant too large");
+	
+	C_PpValue result = {
+		.value = value,
+		.is_unsigned = (value > INT64_MAX),
+	};
+	
+	switch (tok->kind)
+	{
+		case C_TokenKind_UIntLiteral:
+		case C_TokenKind_LUIntLiteral:
+		case C_TokenKind_LLUIntLiteral: result.is_unsigned = true; break;
+		default: break;
+	}
+	
+	return result;
+}
+
+static C_PpValue
+C_PpEvalCharLiteral(C_PpEval* ev, const C_PreprocToken* tok)
+{
+	String str = tok->as_string;
+	const uint8* head = Mem_FindByte(str.data, '\'', str.size);
+	const uint8* end = str.data + str.size - 1;
+	
+	Assert(head && head < end);
+	++head;
+	
+	bool is_wide = (head - 1 != str.data);
+	uint32 value = 0;
+	
+	if (head < end)
+		value = (head[0] == '\\') ? C_DecodeEscapeSequence(&head, end) : head[0];
+	else
+		C_PpEvalError(ev, "empty character constant");
+	
+	C_PpValue result = {
+		// NOTE(ljre): 'char' is signed.
+		.value = is_wide ? (uint64)value : (uint64)(int64)(int8)value,
+	};
+	
+	return result;
+}
+
+static C_PpValue
+C_PpEvalUnary(C_PpEval* ev)
+{
+	C_PpValue result = { 0 };
+	C_PreprocTokenList* head = ev->head;
+	
+	if (!head)
+	{
+		C_PpEvalError(ev, "expected an expression");
+		return result;
+	}
+	
+	C_PpEvalNext(ev);
+	
+	switch (head->tok.kind)
+	{
+		case C_TokenKind_IntLiteral:
+		case C_TokenKind_LIntLiteral:
+		case C_TokenKind_LLIntLiteral:
+		case C_TokenKind_UIntLiteral:
+		case C_TokenKind_LUIntLiteral:
+		case C_TokenKind_LLUIntLiteral: result = C_PpEvalIntLiteral(ev, &head->tok); break;
+		
+		case C_TokenKind_CharLiteral: result = C_PpEvalCharLiteral(ev, &head->tok); break;
+		
+		// NOTE(ljre): Whatever identifier is left after macro expansion (even keywords) is just 0.
+		case C_TokenKind_Identifier: break;
+		
+		case C_TokenKind_Plus: result = C_PpEvalUnary(ev); break;
+		case C_TokenKind_Minus: result = C_PpEvalUnary(ev); result.value = -result.value; break;
+		case C_TokenKind_Not: result = C_PpEvalUnary(ev); result.value = ~result.value; break;
+		case C_TokenKind_LNot: result = C_PpEvalUnary(ev); result = (C_PpValue) { result.value == 0 }; break;
+		
+		case C_TokenKind_LeftParen:
+		{
+			result = C_PpEvalExpression(ev);
+			
+			if (C_PpEvalPeek(ev) == C_TokenKind_RightParen)
+				C_PpEvalNext(ev);
+			else
+				C_PpEvalError(ev, "expected ')'");
+		} break;
+		
+		case C_TokenKind_FloatLiteral:
+		case C_TokenKind_DoubleLiteral:
+		case C_TokenKind_LongDoubleLiteral: C_PpEvalError(ev, "floating constant"); break;
+		
+		default: C_PpEvalError(ev, "expected an expression"); break;
+	}
+	
+	return result;
+}
+
+static int32
+C_PpBinaryPrecedence(C_TokenKind kind)
+{
+	switch (kind)
+	{
+		case C_TokenKind_Mul: case C_TokenKind_Div: case C_TokenKind_Mod: return 10;
+		case C_TokenKind_Plus: case C_TokenKind_Minus: return 9;
+		case C_TokenKind_LeftShift: case C_TokenKind_RightShift: return 8;
+		case C_TokenKind_LThan: case C_TokenKind_GThan: case C_TokenKind_LEqual: case C_TokenKind_GEqual: return 7;
+		case C_TokenKind_Equals: case C_TokenKind_NotEquals: return 6;
+		case C_TokenKind_And: return 5;
+		case C_TokenKind_Xor: return 4;
+		case C_TokenKind_Or: return 3;
+		case C_TokenKind_LAnd: return 2;
+		case C_TokenKind_LOr: return 1;
+		default: return 0;
+	}
+}
+
+static C_PpValue
+C_PpEvalBinaryOp(C_PpEval* ev, C_TokenKind op, C_PpValue left, C_PpValue right)
+{
+	bool is_unsigned = left.is_unsigned || right.is_unsigned;
+	uint64 l = left.value;
+	uint64 r = right.value;
+	C_PpValue result = { 0 };
+	
+	switch (op)
+	{
+		case C_TokenKind_Mul: result = (C_PpValue) { l * r, is_unsigned }; break;
+		case C_TokenKind_Plus: result = (C_PpValue) { l + r, is_unsigned }; break;
+		case C_TokenKind_Minus: result = (C_PpValue) { l - r, is_unsigned }; break;
+		case C_TokenKind_And: result = (C_PpValue) { l & r, is_unsigned }; break;
+		case C_TokenKind_Xor: result = (C_PpValue) { l ^ r, is_unsigned }; break;
+		case C_TokenKind_Or: result = (C_PpValue) { l | r, is_unsigned }; break;
+		
+		case C_TokenKind_Div:
+		case C_TokenKind_Mod:
+		{
+			if (r == 0)
+			{
+				C_PpEvalError(ev, "division by zero");
+				break;
+			}
+			
+			result.is_unsigned = is_unsigned;
+			
+			if (is_unsigned)
+				result.value = (op == C_TokenKind_Div) ? l / r : l % r;
+			else if ((int64)l == INT64_MIN && (int64)r == -1)
+				result.value = (op == C_TokenKind_Div) ? l : 0;
+			else
+				result.value = (op == C_TokenKind_Div) ? (uint64)((int64)l / (int64)r) : (uint64)((int64)l % (int64)r);
+		} break;
+		
+		// NOTE(ljre): The type of a shift is the type of its left operand.
+		case C_TokenKind_LeftShift:
+		case C_TokenKind_RightShift:
+		{
+			bool is_left = (op == C_TokenKind_LeftShift);
+			
+			// NOTE(ljre): A negative amount shifts the other way around.
+			if (!right.is_unsigned && (int64)r < 0)
+				is_left = !is_left, r = -r;
+			
+			result.is_unsigned = left.is_unsigned;
+			
+			if (r >= 64)
+				result.value = (!is_left && !left.is_unsigned && (int64)l < 0) ? (uint64)-1 : 0;
+			else if (is_left)
+				result.value = l << r;
+			else if (left.is_unsigned)
+				result.value = l >> r;
+			else
+				result.value = (uint64)((int64)l >> r);
+		} break;
+		
+		case C_TokenKind_LThan: result.value = is_unsigned ? l < r : (int64)l < (int64)r; break;
+		case C_TokenKind_GThan: result.value = is_unsigned ? l > r : (int64)l > (int64)r; break;
+		case C_TokenKind_LEqual: result.value = is_unsigned ? l <= r : (int64)l <= (int64)r; break;
+		case C_TokenKind_GEqual: result.value = is_unsigned ? l >= r : (int64)l >= (int64)r; break;
+		case C_TokenKind_Equals: result.value = (l == r); break;
+		case C_TokenKind_NotEquals: result.value = (l != r); break;
+		
+		default: Unreachable(); break;
+	}
+	
+	return result;
+}
+
+// NOTE(ljre): Precedence climbing. Operands of '&&' and '||' that don't matter are still parsed, but
+//             with 'ev->unevaluated' set.
+static C_PpValue
+C_PpEvalBinary(C_PpEval* ev, int32 min_precedence)
+{
+	C_PpValue left = C_PpEvalUnary(ev);
+	
+	for (;;)
+	{
+		C_TokenKind op = C_PpEvalPeek(ev);
+		int32 precedence = C_PpBinaryPrecedence(op);
+		
+		if (precedence == 0 || precedence < min_precedence)
+			break;
+		
+		C_PpEvalNext(ev);
+		
+		if (op == C_TokenKind_LAnd || op == C_TokenKind_LOr)
+		{
+			bool short_circuit = (op == C_TokenKind_LAnd) ? left.value == 0 : left.value != 0;
+			
+			ev->unevaluated += short_circuit;
+			C_PpValue right = C_PpEvalBinary(ev, precedence + 1);
+			ev->unevaluated -= short_circuit;
+			
+			if (op == C_TokenKind_LAnd)
+				left = (C_PpValue) { left.value != 0 && right.value != 0 };
+			else
+				left = (C_PpValue) { left.value != 0 || right.value != 0 };
+		}
+		else
+		{
+			C_PpValue right = C_PpEvalBinary(ev, precedence + 1);
+			left = C_PpEvalBinaryOp(ev, op, left, right);
+		}
+	}
+	
+	return left;
+}
+
+static C_PpValue
+C_PpEvalExpression(C_PpEval* ev)
+{
+	C_PpValue cond = C_PpEvalBinary(ev, 1);
+	
+	if (C_PpEvalPeek(ev) != C_TokenKind_QuestionMark)
+		return cond;
+	
+	C_PpEvalNext(ev);
+	
+	ev->unevaluated += (cond.value == 0);
+	C_PpValue left = C_PpEvalExpression(ev);
+	ev->unevaluated -= (cond.value == 0);
+	
+	if (C_PpEvalPeek(ev) == C_TokenKind_Colon)
+		C_PpEvalNext(ev);
+	else
+		C_PpEvalError(ev, "expected ':'");
+	
+	ev->unevaluated += (cond.value != 0);
+	C_PpValue right = C_PpEvalExpression(ev);
+	ev->unevaluated -= (cond.value != 0);
+	
+	C_PpValue result = cond.value ? left : right;
+	result.is_unsigned = left.is_unsigned || right.is_unsigned;
+	
+	return result;
+}
+
+// NOTE(ljre): Macro-expands the rest of the line (resolving 'defined' first) and evaluates it.
+//             Returns false on errors.
+static bool
+C_PpEvalCondition(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	C_PreprocTokenList* tokens = NULL;
+	C_PreprocTokenList** head = &tokens;
+	bool ok = true;
+	
+	while (rd->tok.kind && rd->tok.kind != C_TokenKind_NewLine)
+	{
+		if (rd->tok.kind == C_TokenKind_Identifier && rd->tok.symbol == C_KnownSymbol_Defined)
+		{
+			C_PreprocToken tok = rd->tok;
+			C_SourceLoc loc = C_PpTokenLoc(pp, rd);
+			C_PpNextToken(rd);
+			
+			bool has_paren = C_PpTryEatToken(rd, C_TokenKind_LeftParen);
+			
+			if (rd->tok.kind != C_TokenKind_Identifier)
+			{
+				C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpExpectedDefinedName, 0);
+				ok = false;
+				break;
+			}
+			
+			tok.kind = C_TokenKind_IntLiteral;
+			tok.symbol = 0;
+			tok.as_string = C_PpIsMacroDefined(pp, rd->tok.symbol) ? Str("1") : Str("0");
+			C_PpNextToken(rd);
+			
+			if (has_paren && !C_PpTryEatToken(rd, C_TokenKind_RightParen))
+			{
+				C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpExpectedDefinedParen, 0);
+				ok = false;
+				break;
+			}
+			
+			head = C_PpQueueToken(head, pp->tu->scratch_arena, &tok, NULL, loc);
+			continue;
+		}
+		
+		if (rd->tok.kind == C_TokenKind_Identifier && C_PpTryToExpandMacro(pp, rd, NULL))
+			continue;
+		
+		head = C_PpQueueToken(head, pp->tu->scratch_arena, &rd->tok, NULL, C_PpTokenLoc(pp, rd));
+		C_PpNextToken(rd);
+	}
+	
+	if (!ok)
+		return false;
+	
+	C_PpEval ev = {
+		.pp = pp,
+		.head = tokens,
+		.end_loc = C_PpTokenLoc(pp, rd),
+		.ok = true,
+	};
+	
+	C_PpValue value = C_PpEvalExpression(&ev);
+	
+	if (ev.head)
+		C_PpEvalError(&ev, "unexpected token");
+	
+	return ev.ok && value.value != 0;
+}
+
+static void
+C_PpIf(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	C_SymbolId directive = rd->tok.symbol;
+	bool value;
+	
+	C_PpNextToken(rd);
+	
+	if (directive == C_TokenKind_If)
+		value = C_PpEvalCondition(pp, rd);
+	else if (rd->tok.kind != C_TokenKind_Identifier)
+	{
+		C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpExpectedIfdefName, 0);
+		value = false;
+	}
+	else
+		value = C_PpIsMacroDefined(pp, rd->tok.symbol) == (directive == C_KnownSymbol_Ifdef);
+	
+	C_PpCondition* cond = pp->free_conditions;
+	if (cond)
+		pp->free_conditions = cond->next;
+	else
+		cond = Arena_PushStruct(pp->tu->stage_arena, C_PpCondition);
+	
+	cond->next = pp->conditions;
+	cond->taken = value;
+	cond->seen_else = false;
+	pp->conditions = cond;
+	
+	if (!value)
+		C_PpSkipGroup(pp, rd);
+}
+
+static void
+C_PpElse(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	C_SymbolId directive = rd->tok.symbol;
+	C_PpCondition* cond = pp->conditions;
+	
+	if (cond == pp->file_conditions)
+	{
+		C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpElseWithoutIf, 1, rd->tok.as_string);
+		return;
+	}
+	
+	if (cond->seen_else)
+		C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpElseAfterElse, 1, rd->tok.as_string);
+	
+	C_PpNextToken(rd);
+	cond->seen_else |= (directive == C_TokenKind_Else);
+	
+	// NOTE(ljre): If a group was already taken, this is the end of it. Every #elif and #else after it
+	//             still comes back here, so one after an #else is reported.
+	if (cond->taken)
+	{
+		C_PpSkipGroup(pp, rd);
+		return;
+	}
+	
+	bool value = (directive == C_TokenKind_Else) || C_PpEvalCondition(pp, rd);
+	
+	if (value)
+		cond->taken = true;
+	else
+		C_PpSkipGroup(pp, rd);
+}
+
+static void
+C_PpEndif(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	C_PpCondition* cond = pp->conditions;
+	
+	if (cond == pp->file_conditions)
+	{
+		C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpEndifWithoutIf, 0);
+		return;
+	}
+	
+	pp->conditions = cond->next;
+	cond->next = pp->free_conditions;
+	pp->free_conditions = cond;
+}
+
+//~ NOTE(ljre): Pragmas
+// NOTE(ljre): 'tokens' is what follows '#pragma' (or what's inside _Pragma or __pragma), 'count' tokens
+//             of it. '#pragma once' is handled right here, anything else goes to the output as a single
+//             HashtagPragma token spelling the whole pragma, for the compiler proper to deal with.
+static void
+C_PpHandlePragma(C_PpContext* pp, C_PpTokenReader tokens, uint32 count, const C_PreprocToken* at, C_SourceLoc loc)
+{
+	if (count == 1 && tokens.tok.kind == C_TokenKind_Identifier && tokens.tok.symbol == C_KnownSymbol_Once)
+	{
+		C_PpMarkIncludedOnce(pp, pp->current_file);
+		return;
+	}
+	
+	for Arena_TempScope(pp->tu->scratch_arena)
+	{
+		uint8* const begin = Arena_End(pp->tu->scratch_arena);
+		Arena_PushString(pp->tu->scratch_arena, Str("#pragma"));
+		
+		for (uint32 i = 0; i < count; ++i, C_PpNextToken(&tokens))
+		{
+			uint32 leading_spaces = (i == 0) ? 1 : tokens.tok.leading_spaces;
+			
+			if (leading_spaces > 0)
+				Mem_Set(Arena_PushDirtyAligned(pp->tu->scratch_arena, leading_spaces, 1), ' ', leading_spaces);
+			
+			Arena_PushString(pp->tu->scratch_arena, tokens.tok.as_string);
+		}
+		
+		uint8* const end = Arena_End(pp->tu->scratch_arena);
+		
+		C_PreprocToken pragma = {
+			.kind = C_TokenKind_HashtagPragma,
+			.as_string = StrRange(begin, end),
+		};
+		
+		C_PpWriteToken(pp, &pragma, loc);
+	}
+}
+
+static void
+C_PpPragma(C_PpContext* pp, C_PpTokenReader* rd)
+{
+	C_PreprocToken at = rd->tok;
+	C_SourceLoc loc = C_PpTokenLoc(pp, rd);
+	C_PpNextToken(rd);
+	
+	C_PpTokenReader first = *rd;
+	uint32 count = 0;
+	
+	while (rd->tok.kind && rd->tok.kind != C_TokenKind_NewLine)
+	{
+		++count;
+		C_PpNextToken(rd);
 	}
 	
-	return C_PpInsertMacroToHashmap(pp, &macro);
+	C_PpHandlePragma(pp, first, count, &at, loc);
 }
 
+// NOTE(ljre): '_Pragma("...")' or '__pragma(...)' in the middle of normal text. 'rd' is at the operator's
+//             name. If it's not followed by '(', returns false and 'rd' is untouched. Otherwise 'rd' is
+//             left after the ')'.
 static bool
-C_PpUndefineMacro(C_PpContext* pp, C_PpTokenReader* rd)
+C_PpPragmaOperator(C_PpContext* pp, C_PpTokenReader* rd)
 {
-	if (rd->tok.kind != C_TokenKind_Identifier)
-	{
-		C_PpPushError(pp, rd, "expected identifier after #undef directive.");
+	C_PreprocToken at = rd->tok;
+	C_SourceLoc loc = C_PpTokenLoc(pp, rd);
+	
+	if (C_PpPeekToken(rd).kind != C_TokenKind_LeftParen)
 		return false;
+	
+	C_PpNextToken(rd);
+	C_PpNextToken(rd);
+	
+	C_PpTokenReader first = *rd;
+	uint32 count = C_PpEatTokenBalanced(rd, C_TokenKind_LeftParen, C_TokenKind_RightParen, 1);
+	
+	if (!C_PpTryEatToken(rd, C_TokenKind_RightParen))
+	{
+		C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpUnterminatedPragmaOperator, 1, at.as_string);
+		return true;
 	}
 	
-	C_Macro* macro = C_PpFindMacro(pp, rd->tok.as_string);
-	if (!macro)
-		return false;
+	if (at.symbol == C_TokenKind_MsvcPragma)
+	{
+		C_PpHandlePragma(pp, first, count, &at, loc);
+		return true;
+	}
+	
+	String str = first.tok.as_string;
+	
+	if (count != 1 || first.tok.kind != C_TokenKind_StringLiteral || str.size < 2 || str.data[0] != '"')
+	{
+		C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpBadPragmaOperator, 0);
+		return true;
+	}
+	
+	// NOTE(ljre): The string is destringized and tokenized again, as if it was the rest of a '#pragma' line.
+	for Arena_TempScope(pp->tu->scratch_arena)
+	{
+		String contents = C_PpUnstringify(pp->tu->scratch_arena, str);
+		C_PreprocTokenArray* array = C_TokenizeForPreproc(pp->tu, pp->tu->scratch_arena, contents, NULL);
+		
+		if (array)
+			C_PpHandlePragma(pp, C_PpMakeTokenReader(NULL, array, 0), array->size, &at, loc);
+	}
 	
-	macro->is_defined = false;
 	return true;
 }
 
+//~ NOTE(ljre): #error and #warning
 static void
-C_PpInclude(C_PpContext* pp, C_PpTokenReader* rd)
+C_PpErrorDirective(C_PpContext* pp, C_PpTokenReader* rd)
 {
-	C_PreprocToken peek = C_PpPeekToken(rd);
-	C_LoadedFile* file = NULL;
-	String include_name = StrNull;
-	uint32 line = rd->tok.line;
+	bool is_warning = (rd->tok.symbol == C_KnownSymbol_Warning);
+	C_SourceLoc loc = C_PpTokenLoc(pp, rd);
 	
-	for Arena_TempScope(pp->tu->scratch_arena)
-	{
-		if (rd->tok.kind == C_TokenKind_StringLiteral && (!peek.kind || peek.kind == C_TokenKind_NewLine))
-		{
-			include_name = C_PpUnstringify(pp->tu->scratch_arena, rd->tok.as_string);
-			file = C_TryToIncludeFile(pp, include_name, true);
-		}
-		else if (rd->tok.kind == C_TokenKind_LThan)
-		{
-			C_PpNextToken(rd);
-			
-			C_PreprocTokenList* first = rd->list;
-			uint32 count = 0;
-			bool error = false;
-			
-			while (rd->tok.kind && rd->tok.kind != C_TokenKind_GThan)
-			{
-				if (rd->tok.kind == C_TokenKind_NewLine)
-				{
-					error = true;
-					C_PpPushError(pp, rd, "unexpected end-of-line in include file name.");
-					break;
-				}
-				
-				++count;
-				C_PpNextToken(rd);
-			}
-			
-			if (!error)
-			{
-				include_name = C_PpStringifyTokens(pp->tu->scratch_arena, first, count);
-				file = C_TryToIncludeFile(pp, include_name, false);
-			}
-		}
-		else
-		{
-			// TODO: SLOW PATH
-			Assert(false);
-		}
-	}
+	// NOTE(ljre): Disabled warnings are dropped before the message is even looked at.
+	if (is_warning && !C_IsWarningEnabled(pp->tu->options, C_Warning_WarningDirective))
+		return;
 	
-	if (file)
+	C_PpNextToken(rd);
+	
+	// NOTE(ljre): Directives always come straight from the file, so the message is just the source text
+	//             from the first token to the end of the last one.
+	String message = StrNull;
+	
+	if (rd->tok.kind && rd->tok.kind != C_TokenKind_NewLine)
 	{
-		if (!(file->flags & C_LoadedFileFlags_PragmaOnce))
+		const uint8* begin = rd->tok.as_string.data;
+		const uint8* end = begin;
+		
+		while (rd->tok.kind && rd->tok.kind != C_TokenKind_NewLine)
 		{
-			C_SourceLocation* included_from = &(C_SourceLocation) {
-				.included_from = pp->included_from,
-				.expanded_from = NULL,
-				.filepath = file->path,
-				.leading_spaces = 0,
-				.line = line,
-				.col = 1,
-			};
-			
-			included_from = Arena_PushStructData(pp->tu->loc_arena, C_SourceLocation, included_from);
-			C_PpPreprocessFile(pp, file, included_from);
+			end = rd->tok.as_string.data + rd->tok.as_string.size;
+			C_PpNextToken(rd);
 		}
+		
+		message = StrRange(begin, end);
 	}
-	else
-		C_PpPushError(pp, rd, "could not include '%S'.", include_name);
-}
-
-static void
-C_PpIfdef(C_PpContext* pp, C_PpTokenReader* rd)
-{
 	
+	C_DiagnosticKind kind = is_warning ? C_DiagnosticKind_PpWarningDirective : C_DiagnosticKind_PpErrorDirective;
+	C_PushDiagnostic(pp->tu, kind, loc, 1, message);
 }
 
 //~ NOTE(ljre): Main preprocess procs
 static void
-C_PpPreprocessFile(C_PpContext* pp, C_LoadedFile* file, C_SourceLocation* included_from)
+C_PpPreprocessFile(C_PpContext* pp, C_LoadedFile* file, C_SourceLoc included_from)
 {
 	if (!file)
 		return;
 	
 	C_LoadedFile* previous_file = pp->current_file;
-	C_SourceLocation* previous_included_from = pp->included_from;
+	C_SourceLoc previous_included_from = pp->included_from;
+	uint32 previous_file_base = pp->file_base;
+	C_PpCondition* previous_file_conditions = pp->file_conditions;
 	pp->current_file = file;
 	pp->included_from = included_from;
+	pp->file_base = C_PpPushLocFile(pp, file, included_from);
+	pp->file_conditions = pp->conditions;
 	
-	C_PpTokenReader* rd = &(C_PpTokenReader) { file->tokens, file->tokens->tok };
+	C_PpTokenReader file_rd = C_PpMakeTokenReader(NULL, file->tokens, 0);
+	C_PpTokenReader* rd = &file_rd;
 	
 	for (Arena_Savepoint scratch_save = Arena_Save(pp->tu->scratch_arena);
 		rd->tok.kind;
@@ -1264,11 +3015,18 @@ C_PpPreprocessFile(C_PpContext* pp, C_LoadedFile* file, C_SourceLocation* includ
 				bool should_push = true;
 				
 				if (rd->tok.kind == C_TokenKind_Identifier)
-					should_push = !C_PpTryToExpandMacro(pp, rd, NULL);
+				{
+					C_SymbolId symbol = rd->tok.symbol;
+					
+					if (symbol == C_KnownSymbol_PragmaOperator || symbol == C_TokenKind_MsvcPragma)
+						should_push = !C_PpPragmaOperator(pp, rd);
+					else
+						should_push = !C_PpTryToExpandMacroToOutput(pp, rd);
+				}
 				
 				if (should_push)
 				{
-					C_PpWriteToken(pp, &rd->tok, rd->list->included_from, rd->list->expanded_from);
+					C_PpWriteToken(pp, &rd->tok, C_PpTokenLoc(pp, rd));
 					C_PpNextToken(rd);
 				}
 			}
@@ -1289,38 +3047,163 @@ C_PpPreprocessFile(C_PpContext* pp, C_LoadedFile* file, C_SourceLocation* includ
 			continue;
 		}
 		
-		String directive = rd->tok.as_string;
-		
-		if (String_Equals(directive, Str("define")))
-		{
-			C_PpNextToken(rd);
-			C_PpDefineMacro(pp, rd);
-		}
-		else if (String_Equals(directive, Str("undef")))
-		{
-			C_PpNextToken(rd);
-			C_PpUndefineMacro(pp, rd);
-		}
-		else if (String_Equals(directive, Str("include")))
-		{
-			C_PpNextToken(rd);
-			C_PpInclude(pp, rd);
-		}
-		else if (String_Equals(directive, Str("ifdef")))
-		{
-			C_PpIfdef(pp, rd);
-		}
-		else
+		switch (rd->tok.symbol)
 		{
-			C_PpPushError(pp, rd, "unknown preprocessor directive '%S'\n", directive);
+			case C_KnownSymbol_Define:
+			{
+				C_PpNextToken(rd);
+				C_PpDefineMacro(pp, rd);
+			} break;
+			
+			case C_KnownSymbol_Undef:
+			{
+				C_PpNextToken(rd);
+				C_PpUndefineMacro(pp, rd);
+			} break;
+			
+			case C_KnownSymbol_Include:
+			{
+				C_PpNextToken(rd);
+				C_PpInclude(pp, rd);
+			} break;
+			
+			case C_TokenKind_If:
+			case C_KnownSymbol_Ifdef:
+			case C_KnownSymbol_Ifndef:
+			{
+				C_PpIf(pp, rd);
+			} break;
+			
+			case C_KnownSymbol_Elif:
+			case C_TokenKind_Else:
+			{
+				C_PpElse(pp, rd);
+			} break;
+			
+			case C_KnownSymbol_Endif:
+			{
+				C_PpEndif(pp, rd);
+			} break;
+			
+			case C_KnownSymbol_Pragma:
+			{
+				C_PpPragma(pp, rd);
+			} break;
+			
+			case C_KnownSymbol_Error:
+			case C_KnownSymbol_Warning:
+			{
+				C_PpErrorDirective(pp, rd);
+			} break;
+			
+			default:
+			{
+				C_PpPushDiagnostic(pp, rd, C_DiagnosticKind_PpUnknownDirective, 1, rd->tok.as_string);
+			} break;
 		}
 		
 		while (rd->tok.kind && rd->tok.kind != C_TokenKind_NewLine)
 			C_PpNextToken(rd);
 	}
 	
+	if (pp->conditions != pp->file_conditions)
+	{
+		C_SourceLoc end_loc = pp->file_base + (uint32)file->contents.size;
+		C_PushDiagnostic(pp->tu, C_DiagnosticKind_PpUnterminatedConditional, end_loc, 1, file->path);
+		
+		while (pp->conditions != pp->file_conditions)
+			C_PpEndif(pp, rd);
+	}
+	
 	pp->current_file = previous_file;
 	pp->included_from = previous_included_from;
+	pp->file_base = previous_file_base;
+	pp->file_conditions = previous_file_conditions;
+}
+
+static void
+C_PpPushCommandLineDirective(Arena* arena, String directive, String text)
+{
+	Arena_PushString(arena, directive);
+	uint8* data = Arena_PushMemory(arena, text.data, text.size);
+	Arena_PushString(arena, Str("\n"));
+	
+	// NOTE(ljre): A line break would end the directive early.
+	for (uintsize i = 0; i < text.size; ++i)
+	{
+		if (data[i] == '\n' || data[i] == '\r')
+			data[i] = ' ';
+	}
+}
+
+// NOTE(ljre): 'tu' should be a context made just for this, whose 'stage_arena' is the 'cache_arena': the
+//             result is shared by every TU until the end of the process. Its other arenas only need to
+//             last until its diagnostics are written.
+static C_PredefinedMacros*
+C_CreatePredefinedMacros(C_TuContext* tu)
+{
+	const C_CompilerOptions* options = tu->options;
+	Arena* arena = tu->cache_arena;
+	
+	//- NOTE(ljre): Write every definition to a single file, so it's tokenized in one go.
+	uint8* const begin = Arena_End(arena);
+	
+	for (uintsize i = 0; i < options->predefined_macros_count; ++i)
+		C_PpPushCommandLineDirective(arena, Str("#define "), options->predefined_macros[i]);
+	for (uintsize i = 0; i < options->undefined_macros_count; ++i)
+		C_PpPushCommandLineDirective(arena, Str("#undef "), options->undefined_macros[i]);
+	
+	uint8* const end = Arena_End(arena);
+	
+	C_LoadedFile* file = Arena_PushStruct(arena, C_LoadedFile);
+	file->path = Str("<command line>");
+	file->contents = StrRange(begin, end);
+	file->tokens = C_TokenizeForPreproc(tu, arena, file->contents, NULL);
+	
+	//- NOTE(ljre): Run it through the preprocessor, just like a normal file.
+	C_PpContext* pp = &(C_PpContext) {
+		.tu = tu,
+	};
+	
+	C_PpInitLocTable(tu);
+	
+	C_PpAllocMacroTable(pp, 10);
+	pp->hideset_memo = Arena_PushArray(arena, C_PpHidesetMemo, C_PP_HIDESET_MEMO_SIZE);
+	C_PpGrowHidesetTable(pp);
+	
+	pp->once_files_log2cap = 6;
+	pp->once_files = Arena_PushArray(arena, C_LoadedFile*, 1u << pp->once_files_log2cap);
+	
+	C_PpDefineBuiltinMacros(pp);
+	
+	if (file->tokens)
+		C_PpPreprocessFile(pp, file, 0);
+	else
+		C_PpPushDiagnostic(pp, NULL, C_DiagnosticKind_BadPredefinedMacros, 0);
+	
+	//- NOTE(ljre): Keep whatever ended up defined.
+	C_MacroTable* table = &tu->macro_table;
+	C_Macro* macros = Arena_EndAligned(arena, alignof(C_Macro));
+	uint32 count = 0;
+	
+	for (uint32 i = 0; i < 1u << table->log2cap; ++i)
+	{
+		if (!(table->ctrl[i] & 0x80))
+		{
+			C_Macro* macro = Arena_PushStructData(arena, C_Macro, table->slots[i]);
+			macro->definition_loc = 0;
+			++count;
+		}
+	}
+	
+	C_PredefinedMacros* result = Arena_PushStruct(arena, C_PredefinedMacros);
+	result->file = file;
+	result->count = count;
+	result->macros = macros;
+	
+	*table = (C_MacroTable) { 0 };
+	
+	return result;
 }
 
 static void
@@ -1335,74 +3218,236 @@ C_Preprocess(C_TuContext* tu)
 		},
 	};
 	
+	C_PpInitLocTable(tu);
+	
+	if (tu->output_pipe)
+		Atomic_StorePtr((void* volatile*)&tu->output_pipe->tokens, pp->output.tokens);
+	
 	for Arena_TempScope(tu->stage_arena)
 	{
-		tu->macros_hashmap = C_AllocHashMapChunk(tu->stage_arena, 18, sizeof(C_Macro*));
-		tu->files_hashmap = C_AllocHashMapChunk(tu->stage_arena, 18, sizeof(C_LoadedFile));
+		C_PpAllocMacroTable(pp, 10);
+		pp->hideset_memo = Arena_PushArray(tu->stage_arena, C_PpHidesetMemo, C_PP_HIDESET_MEMO_SIZE);
+		C_PpGrowHidesetTable(pp);
 		
-		C_PpDefineBuiltinMacros(pp);
-		C_PpPredefineMacros(pp, tu->options->predefined_macros, tu->options->predefined_macros_count);
+		pp->once_files_log2cap = 6;
+		pp->once_files = Arena_PushArray(tu->stage_arena, C_LoadedFile*, 1u << pp->once_files_log2cap);
 		
-		C_LoadedFile* first_file = C_PpTryToLoadFile(pp, tu->main_file_name);
+		C_PpPredefineMacros(pp, tu->predefined_macros);
+		
+		C_LoadedFile* first_file = C_PpTryToLoadFile(pp, tu->main_file_name, C_LoadedFileFlags_Null);
 		if (first_file)
 		{
-			C_PpPreprocessFile(pp, first_file, NULL);
+			C_PpPreprocessFile(pp, first_file, 0);
 			tu->preprocessed_source = pp->output;
 		}
 		else
-			C_PpPushError(pp, NULL, "could not load input file '%S'.", tu->main_file_name);
+			C_PpPushDiagnostic(pp, NULL, C_DiagnosticKind_CouldNotLoadInput, 1, tu->main_file_name);
 	}
+	
+	if (tu->output_pipe)
+		C_PpPublishOutput(pp, true);
 }
 
 //~ NOTE(ljre): Stringify token stream
-static String
-C_WritePreprocessedTokensGnu(C_TuContext* tu, Arena* arena)
+//
+// The -E output is formatted into a fixed size buffer, which is written to the output file every time
+// it fills up. Tokens can be given a batch at a time, so the writer can follow the preprocessor through
+// a C_OutputPipe and memory use doesn't grow with the size of the output.
+enum { C_GNU_WRITER_BUFFER_SIZE = 64 << 10 };
+
+struct C_GnuWriter
 {
-	C_TokenStream* stream = &tu->preprocessed_source;
-	if (stream->size == 0)
-		return StrNull;
+	OS_File file;
+	bool ok;
+	OS_Error err;
+	
+	// NOTE(ljre): Line indices are built in 'line_arena' when a file is first written, so it should live as
+	//             long as the file cache does.
+	C_LocTable* locs;
+	Arena* line_arena;
+	
+	// NOTE(ljre): The file and line of the last lookup. Consecutive tokens are almost always in the same
+	//             line, so most of them don't need to search for anything.
+	const C_LocFile* loc_file;
+	const C_LineIndex* lines;
+	uint32 line;
+	uint32 line_begin, line_end;
+	
+	// NOTE(ljre): Every time a file is entered it gets a new base, so including the same file twice still
+	//             starts a new line marker.
+	String last_filepath;
+	uint32 last_file_base;
+	uint32 last_line;
+	C_TokenKind last_kind;
+	
+	uint32 size;
+	uint8 buffer[C_GNU_WRITER_BUFFER_SIZE];
+}
+typedef C_GnuWriter;
+
+static void
+C_GnuWriterFlush(C_GnuWriter* w)
+{
+	if (w->ok && w->size > 0)
+		w->ok = OS_WriteFile(w->file, StrMake(w->size, w->buffer), &w->err);
 	
-	uint8* const begin = Arena_End(arena);
-	C_SourceLocation* last_loc = NULL;
+	w->size = 0;
+}
+
+static void
+C_GnuWriterPush(C_GnuWriter* w, String str)
+{
+	while (str.size > 0)
+	{
+		if (w->size == sizeof(w->buffer))
+			C_GnuWriterFlush(w);
+		
+		uintsize count = Min(str.size, sizeof(w->buffer) - w->size);
+		Mem_Copy(w->buffer + w->size, str.data, count);
+		
+		w->size += count;
+		str.data += count;
+		str.size -= count;
+	}
+}
+
+static void
+C_GnuWriterPushSpaces(C_GnuWriter* w, uint32 count)
+{
+	static const char spaces[] = "                                ";
+	
+	while (count > 0)
+	{
+		uint32 chunk = Min(count, sizeof(spaces) - 1);
+		C_GnuWriterPush(w, StrMake(chunk, spaces));
+		count -= chunk;
+	}
+}
+
+static void
+C_GnuWriterPushLineMarker(C_GnuWriter* w, bool on_new_line, uint32 line, String filepath)
+{
+	char prefix[32];
+	uintsize size = String_PrintfBuffer(prefix, sizeof(prefix), "%s# %u \"", on_new_line ? "\n" : "", line);
+	
+	C_GnuWriterPush(w, StrMake(size, prefix));
+	C_GnuWriterPush(w, filepath);
+	C_GnuWriterPush(w, Str("\"\n"));
+}
+
+// NOTE(ljre): Makes 'w->loc_file' and 'w->line' be where the file location 'loc' is. Returns false if
+//             it's nowhere.
+static bool
+C_GnuWriterSeekLine(C_GnuWriter* w, C_SourceLoc loc)
+{
+	if (loc >= w->line_begin && loc < w->line_end)
+		return true;
+	
+	const C_LocFile* loc_file = w->loc_file;
 	
-	Arena_Printf(arena, "# %u \"%S\"\n", stream->tokens[0].loc->line, stream->tokens[0].loc->filepath);
+	if (!loc_file || loc < loc_file->base || loc - loc_file->base > loc_file->file->contents.size)
+	{
+		loc_file = C_FindLocFile(w->locs, loc);
+		if (!loc_file)
+			return false;
+		
+		w->loc_file = loc_file;
+		w->lines = C_GetLineIndex(loc_file->file, w->line_arena);
+	}
+	
+	uint32 line, col;
+	C_LineColumnFromOffset(w->lines, loc - loc_file->base, &line, &col);
+	
+	w->line = line;
+	w->line_begin = loc_file->base + w->lines->starts[line-1];
+	
+	if (line < w->lines->count)
+		w->line_end = loc_file->base + w->lines->starts[line];
+	else
+		w->line_end = loc_file->base + (uint32)loc_file->file->contents.size + 1;
 	
-	for (int32 i = 0; i < stream->size; ++i)
+	return true;
+}
+
+static void
+C_GnuWriterWriteTokens(C_GnuWriter* w, const C_Token* tokens, uint32 count)
+{
+	for (uint32 i = 0; i < count; ++i)
 	{
-		C_Token tok = stream->tokens[i];
-		C_SourceLocation* loc = tok.loc;
+		C_Token tok = tokens[i];
 		
-		// Handle preproc shenanigans
-		while (loc->expanded_from)
-			loc = loc->expanded_from;
+		// NOTE(ljre): Macro expansions are written where the outermost macro was used. A token with no
+		//             location at all just stays where the last one was.
+		String filepath = w->last_filepath;
+		uint32 file_base = w->last_file_base;
+		uint32 line = w->last_line;
 		
-		if (last_loc)
+		if (C_GnuWriterSeekLine(w, C_GetFileLoc(w->locs, tok.loc)))
 		{
-			if (loc->filepath.data != last_loc->filepath.data)
-				Arena_Printf(arena, "\n# %u \"%S\"\n", tok.loc->line, tok.loc->filepath);
-			else if (loc->line != last_loc->line)
-			{
-				uint32 diff = loc->line - last_loc->line;
-				
-				if (diff > 4)
-					Arena_Printf(arena, "\n# %u \"%S\"\n", loc->line, loc->filepath);
-				else
-					Arena_PushMemory(arena, "\n\n\n\n", diff);
-			}
+			filepath = w->loc_file->file->path;
+			file_base = w->loc_file->base;
+			line = w->line;
+		}
+		
+		if (filepath.data && !w->last_filepath.data)
+			C_GnuWriterPushLineMarker(w, false, line, filepath);
+		else if (file_base != w->last_file_base)
+			C_GnuWriterPushLineMarker(w, true, line, filepath);
+		else if (line != w->last_line)
+		{
+			uint32 diff = line - w->last_line;
+			
+			if (diff > 4)
+				C_GnuWriterPushLineMarker(w, true, line, filepath);
+			else
+				C_GnuWriterPush(w, StrMake(diff, "\n\n\n\n"));
+		}
+		else if (tok.kind == C_TokenKind_HashtagPragma || w->last_kind == C_TokenKind_HashtagPragma)
+		{
+			// NOTE(ljre): A pragma needs a line of its own, even if it came from a _Pragma in the
+			//             middle of one.
+			C_GnuWriterPush(w, Str("\n"));
 		}
 		
-		last_loc = loc;
+		w->last_filepath = filepath;
+		w->last_file_base = file_base;
+		w->last_line = line;
+		w->last_kind = tok.kind;
 		
 		// Leading Spaces
-		uint32 leading_spaces = tok.loc->leading_spaces;
-		
-		if (leading_spaces > 0)
-			Mem_Set(Arena_PushDirtyAligned(arena, leading_spaces, 1), ' ', leading_spaces);
+		C_GnuWriterPushSpaces(w, tok.leading_spaces);
 		
 		// Token text
-		Arena_PushString(arena, C_TokenAsString(tok));
+		C_GnuWriterPush(w, C_TokenAsString(tok));
 	}
+}
+
+// NOTE(ljre): Writes tokens as they're published to 'pipe', until the preprocessor is done.
+static void
+C_GnuWriterFollowPipe(C_GnuWriter* w, C_OutputPipe* pipe)
+{
+	uint32 written = 0;
 	
-	uint8* const end = Arena_End(arena);
-	return StrRange(begin, end);
+	for (;;)
+	{
+		uint32 sequence = Atomic_Load32(&pipe->sequence);
+		uint32 done = Atomic_Load32(&pipe->done);
+		uint32 published = Atomic_Load32(&pipe->published);
+		
+		if (written < published)
+		{
+			C_Token* tokens = Atomic_LoadPtr((void* volatile*)&pipe->tokens);
+			C_GnuWriterWriteTokens(w, tokens + written, published - written);
+			written = published;
+		}
+		else if (done)
+			break;
+		else
+		{
+			// NOTE(ljre): Don't hold on to a partial buffer while waiting, whoever reads our output
+			//             might be waiting on it.
+			C_GnuWriterFlush(w);
+			OS_WaitOnAddress(&pipe->sequence, sequence);
+		}
+	}
 }
@@ -1,62 +1,209 @@
 //~ NOTE(ljre): Main lexer
 static inline bool
 C_IsNumberChar(uint8 ch, int32 base)
+{ return Char_Is(ch, Char_DigitClassForBase(base)); }
+
+static inline bool
+C_IsIdentChar(uint8 ch, bool first)
+{ return Char_Is(ch, first ? Char_IdentStart : Char_Ident); }
+
+static inline bool
+C_IsBlankChar(uint8 ch, bool include_linebreak)
+{ return Char_Is(ch, Char_Blank | (include_linebreak ? Char_LineBreak : 0)); }
+
+// NOTE(ljre): Returns the first byte in [head, end) that is not a space, tab, carriage return or (if
+//             'include_linebreak') line feed.
+static inline const uint8*
+C_SkipBlanks(const uint8* head, const uint8* end, bool include_linebreak)
 {
-	switch (base)
+	// NOTE(ljre): Most runs are a single space or none at all, so don't bother setting up SIMD for those.
+	if (head >= end || !C_IsBlankChar(head[0], include_linebreak))
+		return head;
+	if (head+1 >= end || !C_IsBlankChar(head[1], include_linebreak))
+		return head+1;
+	
+	// NOTE(ljre): When line feeds aren't included, just compare against ' ' twice.
+	uint8 linebreak = include_linebreak ? '\n' : ' ';
+	
+#ifdef __AVX2__
+	// NOTE(ljre): YMM by YMM
 	{
-		case 2: return (ch == '0' || ch == '1');
-		case 8: return (ch >= '0' && ch <= '7');
-		case 10: return (ch >= '0' && ch <= '9');
-		case 16: return (ch >= '0' && ch <= '9' || ch >= 'A' && ch <= 'F' || ch >= 'a' && ch <= 'f');
+		__m256i spaces = _mm256_set1_epi8(' ');
+		__m256i tabs = _mm256_set1_epi8('\t');
+		__m256i carriages = _mm256_set1_epi8('\r');
+		__m256i linebreaks = _mm256_set1_epi8(linebreak);
+		
+		while (head + 32 <= end)
+		{
+			__m256i data = _mm256_loadu_si256((const __m256i*)head);
+			__m256i blank = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(data, spaces), _mm256_cmpeq_epi8(data, tabs)),
+				_mm256_or_si256(_mm256_cmpeq_epi8(data, carriages), _mm256_cmpeq_epi8(data, linebreaks)));
+			uint32 not_blank = ~(uint32)_mm256_movemask_epi8(blank);
+			
+			if (Likely(not_blank != 0))
+				return head + Mem_BitCtz32(not_blank);
+			
+			head += 32;
+		}
 	}
+#endif
 	
-	Assert(false);
-	return 0;
+	// NOTE(ljre): XMM by XMM
+	{
+		__m128i spaces = _mm_set1_epi8(' ');
+		__m128i tabs = _mm_set1_epi8('\t');
+		__m128i carriages = _mm_set1_epi8('\r');
+		__m128i linebreaks = _mm_set1_epi8(linebreak);
+		
+		while (head + 16 <= end)
+		{
+			__m128i data = _mm_loadu_si128((const __m128i*)head);
+			__m128i blank = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(data, spaces), _mm_cmpeq_epi8(data, tabs)),
+				_mm_or_si128(_mm_cmpeq_epi8(data, carriages), _mm_cmpeq_epi8(data, linebreaks)));
+			uint32 not_blank = ~(uint32)_mm_movemask_epi8(blank) & 0xffff;
+			
+			if (Likely(not_blank != 0))
+				return head + Mem_BitCtz32(not_blank);
+			
+			head += 16;
+		}
+	}
+	
+	// NOTE(ljre): Byte by byte
+	while (head < end && C_IsBlankChar(head[0], include_linebreak))
+		++head;
+	
+	return head;
 }
 
-static inline bool
-C_IsIdentChar(uint8 ch, bool first)
+// NOTE(ljre): 'head' should point right after the '//'. Returns the line feed that ends the comment, or
+//             'end'. A line feed escaped by a backslash doesn't end it.
+static inline const uint8*
+C_SkipLineComment(const uint8* head, const uint8* end)
+{
+	const uint8* const begin = head;
+	
+	for (;;)
+	{
+		const uint8* linebreak = Mem_FindByte(head, '\n', end - head);
+		if (!linebreak)
+			return end;
+		
+		const uint8* it = linebreak;
+		if (it > begin && it[-1] == '\r')
+			--it;
+		
+		uintsize backslashes = 0;
+		while (it > begin && it[-1] == '\\')
+			++backslashes, --it;
+		
+		if (backslashes % 2 == 0)
+			return linebreak;
+		
+		head = linebreak + 1;
+	}
+}
+
+// NOTE(ljre): 'head' should point right after the '/*'. Returns the byte after the closing '*/', or 'end'
+//             if the comment is unterminated.
+static inline const uint8*
+C_SkipBlockComment(const uint8* head, const uint8* end)
 {
-	bool result = (ch >= 'a' && ch <= 'z' || ch >= 'A' && ch <= 'Z' || ch == '_');
+#ifdef __AVX2__
+	// NOTE(ljre): YMM by YMM. Compare each byte with '*' and the byte after it with '/'.
+	{
+		__m256i stars = _mm256_set1_epi8('*');
+		__m256i slashes = _mm256_set1_epi8('/');
+		
+		while (head + 33 <= end)
+		{
+			__m256i data = _mm256_loadu_si256((const __m256i*)head);
+			__m256i next = _mm256_loadu_si256((const __m256i*)(head + 1));
+			__m256i found = _mm256_and_si256(_mm256_cmpeq_epi8(data, stars), _mm256_cmpeq_epi8(next, slashes));
+			uint32 mask = (uint32)_mm256_movemask_epi8(found);
+			
+			if (mask != 0)
+				return head + Mem_BitCtz32(mask) + 2;
+			
+			head += 32;
+		}
+	}
+#endif
 	
-	if (!first)
-		result |= (ch >= '0' && ch <= '9');
+	// NOTE(ljre): XMM by XMM
+	{
+		__m128i stars = _mm_set1_epi8('*');
+		__m128i slashes = _mm_set1_epi8('/');
+		
+		while (head + 17 <= end)
+		{
+			__m128i data = _mm_loadu_si128((const __m128i*)head);
+			__m128i next = _mm_loadu_si128((const __m128i*)(head + 1));
+			__m128i found = _mm_and_si128(_mm_cmpeq_epi8(data, stars), _mm_cmpeq_epi8(next, slashes));
+			uint32 mask = (uint32)_mm_movemask_epi8(found);
+			
+			if (mask != 0)
+				return head + Mem_BitCtz32(mask) + 2;
+			
+			head += 16;
+		}
+	}
 	
-	return result;
+	// NOTE(ljre): Byte by byte
+	while (head + 1 < end)
+	{
+		if (head[0] == '*' && head[1] == '/')
+			return head + 2;
+		
+		++head;
+	}
+	
+	return end;
 }
 
+// NOTE(ljre): Skips blanks and comments. Returns how many spaces it's worth for the next token, which
+//             is the number of blank bytes plus one for each comment.
 static inline uintsize
 C_IgnoreWhitespaces(const uint8** phead, const uint8* end, bool include_linebreak, bool include_comments)
 {
 	const uint8* head = *phead;
 	Assert(head <= end);
 	
+	uintsize count = 0;
+	
 	for (;;)
 	{
-		if (head >= end)
+		const uint8* blanks_end = C_SkipBlanks(head, end, include_linebreak);
+		count += blanks_end - head;
+		head = blanks_end;
+		
+		if (head+2 > end)
 			break;
 		
-		if (head+2 <= end && head[0] == '/' && head[1] == '/')
+		// NOTE(ljre): Lines spliced by a backslash between two tokens are just blanks.
+		if (head[0] == '\\' && (head[1] == '\n' || head[1] == '\r' && head+3 <= end && head[2] == '\n'))
 		{
-			head += 2;
-			
-			while (head < end && head[0] != '\n')
-			{
-				if (head+1 < end && head[0] == '\\')
-					++head;
-				++head;
-			}
+			head += (head[1] == '\n') ? 2 : 3;
+			++count;
+			continue;
 		}
 		
-		if (head[0] != ' ' && head[0] != '\t' && head[0] != '\r' && !(include_linebreak && head[0] == '\n'))
+		if (!include_comments || head[0] != '/')
 			break;
 		
-		++head;
+		if (head[1] == '/')
+			head = C_SkipLineComment(head+2, end);
+		else if (head[1] == '*')
+			head = C_SkipBlockComment(head+2, end);
+		else
+			break;
+		
+		++count;
 	}
 	
-	uintsize count = head - *phead;
 	*phead = head;
-	
 	return count;
 }
 
@@ -76,6 +223,7 @@ C_TokenizeStringLiteral(const uint8** phead, const uint8* end, uint8 close_char,
 		{
 			++head;
 			unclosed = false;
+			break;
 		}
 		else
 			++head;
@@ -168,101 +316,279 @@ C_DecodeEscapeSequence(const uint8** phead, const uint8* end)
 	return value;
 }
 
+static Hash_KeywordTable C_keyword_table;
+
+// NOTE(ljre): Must be called once before any thread starts tokenizing.
+static void
+C_InitKeywordTable(void)
+{
+#define X(name, kind) StrInit(name),
+	static const String names[] = { C_GEN_TOKEN_TABLE(X) };
+#undef X
+#define X(name, kind) kind,
+	static const uint8 kinds[] = { C_GEN_TOKEN_TABLE(X) };
+#undef X
+	
+	bool ok = Hash_BuildKeywordTable(&C_keyword_table, names, kinds, ArrayLength(names));
+	SafeAssert(ok);
+}
+
 static inline C_TokenKind
 C_FindKeywordByName(String name)
+{ return (C_TokenKind)Hash_FindKeyword(&C_keyword_table, name); }
+
+//~ NOTE(ljre): Symbols
+static C_SymbolTable*
+C_AllocSymbolTable(Arena* arena, uint32 log2cap)
+{
+	C_SymbolTable* table = Arena_Push(arena, sizeof(C_SymbolTable) + sizeof(C_Symbol*) * (1 << log2cap));
+	table->log2cap = log2cap;
+	
+	return table;
+}
+
+// NOTE(ljre): Only a winning insert takes an ID, after its symbol is published. Whoever finds the symbol
+//             before that has to wait for it.
+static inline C_Symbol*
+C_WaitForSymbolId(C_Symbol* symbol)
+{
+	while (!Atomic_Load32(&symbol->id))
+		Atomic_Pause();
+	
+	return symbol;
+}
+
+// NOTE(ljre): Reserves one slot of 'table' for a new symbol, or returns false if it's full. Once a table
+//             is full, nothing is ever inserted in it again.
+static bool
+C_ReserveSymbolSlot(C_SymbolTable* table)
 {
-#define X(name, kind) { (uint8)(sizeof(name)-1), name, kind },
-	struct
+	uint64 limit = (3ull << table->log2cap) / 4;
+	uint64 reservations = Atomic_Load64(&table->reservations);
+	
+	for (;;)
 	{
-		uint8 size;
-		char name[31];
-		C_TokenKind kind;
+		if ((reservations & UINT32_MAX) >= limit)
+			return false;
+		
+		uint64 desired = reservations + 1 + (1ull << 32);
+		uint64 found = Atomic_CompareExchange64(&table->reservations, reservations, desired);
+		
+		if (found == reservations)
+			return true;
+		
+		reservations = found;
 	}
-	static const table[] = { C_GEN_TOKEN_TABLE(X) };
-#undef X
-	
-	int32 left = 0;
-	int32 right = ArrayLength(table);
+}
+
+static inline void
+C_FinishSymbolSlot(C_SymbolTable* table)
+{ Atomic_FetchAdd64(&table->reservations, -(1ull << 32)); }
+
+static C_Symbol*
+C_FindSymbolInTable(C_SymbolTable* table, uint64 hash, String name)
+{
+	int32 index = Hash_Msi(table->log2cap, hash, (int32)hash);
+	C_Symbol* symbol;
 	
-	while (left < right)
+	while ((symbol = Atomic_LoadPtr((void* volatile*)&table->slots[index])) != NULL)
 	{
-		int32 index = (left + right) / 2;
-		int32 cmp = (int32)name.size - table[index].size;
+		if (symbol->hash == hash && String_Equals(symbol->name, name))
+			return C_WaitForSymbolId(symbol);
 		
-		if (cmp == 0)
+		index = Hash_Msi(table->log2cap, hash, index);
+	}
+	
+	return NULL;
+}
+
+// NOTE(ljre): Returns NULL if 'table' is full and 'name' isn't in it, so it has to go to the next table.
+static C_Symbol*
+C_InternSymbolInTable(C_SymbolTable* root, C_SymbolTable* table, Arena* arena, uint64 hash, String name)
+{
+	int32 index = Hash_Msi(table->log2cap, hash, (int32)hash);
+	
+	uint8* arena_end = Arena_End(arena);
+	C_Symbol* new_symbol = NULL;
+	C_Symbol* symbol = Atomic_LoadPtr((void* volatile*)&table->slots[index]);
+	
+	for (;;)
+	{
+		if (symbol)
 		{
-			int32 len = name.size;
-			
-			const uint8* a = name.data;
-			const uint8* b = (uint8*)table[index].name;
-			
-			while (len--)
+			if (symbol->hash == hash && String_Equals(symbol->name, name))
 			{
-				if (*a != *b)
+				if (new_symbol)
 				{
-					cmp = *a - *b;
-					goto lbl_failed;
+					Arena_Pop(arena, arena_end);
+					C_FinishSymbolSlot(table);
 				}
 				
-				++a;
-				++b;
+				return C_WaitForSymbolId(symbol);
+			}
+			
+			index = Hash_Msi(table->log2cap, hash, index);
+			symbol = Atomic_LoadPtr((void* volatile*)&table->slots[index]);
+			continue;
+		}
+		
+		if (!new_symbol)
+		{
+			if (!C_ReserveSymbolSlot(table))
+			{
+				// NOTE(ljre): Some insert that got a slot before the table filled up might be this very
+				//             name. Once they're all done, whatever isn't in here never will be.
+				while (Atomic_Load64(&table->reservations) >> 32)
+					Atomic_Pause();
+				
+				return C_FindSymbolInTable(table, hash, name);
 			}
 			
-			return table[index].kind;
+			new_symbol = Arena_PushStruct(arena, C_Symbol);
+			new_symbol->hash = hash;
+			new_symbol->name = Arena_PushString(arena, name);
 		}
 		
-		lbl_failed:;
-		if (cmp < 0)
-			right = index;
-		else if (cmp > 0)
-			left = index + 1;
+		symbol = Atomic_CompareExchangePtr((void* volatile*)&table->slots[index], NULL, new_symbol);
+		if (!symbol)
+		{
+			Atomic_Store32(&new_symbol->id, Atomic_FetchAdd32(&root->next_id, 1));
+			C_FinishSymbolSlot(table);
+			
+			return new_symbol;
+		}
+		
+		// NOTE(ljre): Lost the race for this slot. 'symbol' is now whatever the winner put there, so check it.
 	}
+}
+
+// NOTE(ljre): The returned symbol lives as long as the table, so its 'name' can be used in place of 'name'.
+static C_Symbol*
+C_InternSymbolEntry(C_SymbolTable* root, Arena* arena, String name)
+{
+	uint64 hash = Hash_StringHash(name);
+	C_SymbolTable* table = root;
+	
+	for (;;)
+	{
+		C_Symbol* symbol = C_InternSymbolInTable(root, table, arena, hash, name);
+		if (symbol)
+			return symbol;
+		
+		C_SymbolTable* next = Atomic_LoadPtr((void* volatile*)&table->next);
+		
+		if (!next)
+		{
+			uint8* arena_end = Arena_End(arena);
+			C_SymbolTable* new_table = C_AllocSymbolTable(arena, table->log2cap + 1);
+			
+			next = Atomic_CompareExchangePtr((void* volatile*)&table->next, NULL, new_table);
+			if (next)
+				Arena_Pop(arena, arena_end);
+			else
+				next = new_table;
+		}
+		
+		table = next;
+	}
+}
+
+static inline C_SymbolId
+C_InternSymbol(C_SymbolTable* table, Arena* arena, String name)
+{ return C_InternSymbolEntry(table, arena, name)->id; }
+
+// NOTE(ljre): Must be called before any thread starts tokenizing.
+static C_SymbolTable*
+C_CreateSymbolTable(Arena* arena, uint32 log2cap)
+{
+	C_SymbolTable* table = C_AllocSymbolTable(arena, log2cap);
+	table->next_id = C_TokenKind__FirstKeyword;
+	
+#define X(name, kind) { StrInit(name), kind },
+	static const struct { String name; C_TokenKind kind; } keywords[] = { C_GEN_TOKEN_TABLE(X) };
+#undef X
+#define X(name, id) { StrInit(name), C_KnownSymbol_##id },
+	static const struct { String name; C_KnownSymbol id; } known[] = { C_GEN_KNOWN_SYMBOL_TABLE(X) };
+#undef X
+	
+	for (C_TokenKind kind = C_TokenKind__FirstKeyword; kind <= C_TokenKind__LastKeyword; ++kind)
+	{
+		int32 i = 0;
+		while (i < ArrayLength(keywords) && keywords[i].kind != kind)
+			++i;
+		
+		SafeAssert(i < ArrayLength(keywords));
+		SafeAssert(C_InternSymbol(table, arena, keywords[i].name) == kind);
+	}
+	
+	for (int32 i = 0; i < ArrayLength(known); ++i)
+		SafeAssert(C_InternSymbol(table, arena, known[i].name) == known[i].id);
+	
+	return table;
+}
+
+// NOTE(ljre): Returns C_TokenKind_Null if 'symbol' isn't a keyword.
+static inline C_TokenKind
+C_KeywordFromSymbol(C_SymbolId symbol)
+{
+	if (symbol >= C_TokenKind__FirstKeyword && symbol <= C_TokenKind__LastKeyword)
+		return (C_TokenKind)symbol;
 	
 	return C_TokenKind_Null;
 }
 
-static C_PreprocTokenList*
+// NOTE(ljre): Fills 'tokens->symbols'. Interned names are copied, so 'tokens->source' can go away later.
+static void
+C_InternTokenSymbols(C_TuContext* tu, C_PreprocTokenArray* tokens, Arena* output_arena)
+{
+	tokens->symbols = Arena_PushArray(output_arena, C_SymbolId, tokens->size);
+	
+	for (uint32 i = 0; i < tokens->size; ++i)
+	{
+		if (tokens->kinds[i] == C_TokenKind_Identifier)
+		{
+			String name = StrMake(tokens->str_sizes[i], tokens->source.data + tokens->str_offsets[i]);
+			tokens->symbols[i] = C_InternSymbol(tu->symbol_table, tu->symbol_arena, name);
+		}
+	}
+}
+
+static C_PreprocTokenArray*
 C_TokenizeForPreproc(C_TuContext* tu, Arena* output_arena, String source, C_Error* out_error)
 {
-	Arena_Savepoint arena_save = Arena_Save(output_arena);
-	C_PreprocTokenList* result = NULL;
-	C_PreprocTokenList** tok_head = &result;
+	struct TempToken
+	{
+		uint32 str_offset;
+		uint32 str_size;
+		uint16 leading_spaces;
+		uint8 kind;
+	}
+	typedef TempToken;
 	
-	bool ok = true;
+	// NOTE(ljre): Tokens are first pushed to the scratch arena and moved to the output arrays once we know
+	//             how many there are. 'output_arena' might be the scratch arena itself.
+	Arena* temp_arena = tu->scratch_arena;
+	Arena_Savepoint temp_save = Arena_Save(temp_arena);
+	TempToken* temp_tokens = Arena_EndAligned(temp_arena, alignof(TempToken));
+	uint32 token_count = 0;
 	
 	const uint8* const begin = source.data;
 	const uint8* const end = source.data + source.size;
 	
 	const uint8* head = begin;
 	
-	uint32 line = 1;
-	uint32 col = 1;
-	const uint8* prev_head = head;
-	
 	uint32 leading_spaces;
 	
-	while (ok && head < end)
+	while (head < end)
 	{
 		leading_spaces = C_IgnoreWhitespaces(&head, end, false, true);
 		if (head >= end)
 			break;
 		
-		while (prev_head < head)
-		{
-			switch (*prev_head++)
-			{
-				case '\n': ++line;
-				case '\r': col = 1; break;
-				default: ++col; break;
-			}
-		}
-		
 		const uint8* const token_begin = head;
 		C_PreprocToken token = {
 			.kind = C_TokenKind_Null,
 			.leading_spaces = leading_spaces,
-			.line = line,
-			.col = col,
 		};
 		
 		leading_spaces = 0;
@@ -312,7 +638,7 @@ C_TokenizeForPreproc(C_TuContext* tu, Arena* output_arena, String source, C_Erro
 				if (head + 2 < end && head[1] == '.' && head[2] == '.')
 				{
 					token.kind = C_TokenKind_VarArgs;
-					head += 2;
+					head += 3;
 					break;
 				}
 				else if (head + 1 < end && !C_IsNumberChar(head[1], 10))
@@ -342,7 +668,9 @@ C_TokenizeForPreproc(C_TuContext* tu, Arena* output_arena, String source, C_Erro
 					}
 				}
 				
-				while (head < end && C_IsNumberChar(head[0], base))
+				uint8 digit_class = Char_DigitClassForBase(base);
+				
+				while (head < end && Char_Is(head[0], digit_class))
 					++head;
 				
 				if (head < end && head[0] == '.')
@@ -350,7 +678,7 @@ C_TokenizeForPreproc(C_TuContext* tu, Arena* output_arena, String source, C_Erro
 					++head;
 					Assert(base == 10 || base == 16);
 					
-					while (head < end && C_IsNumberChar(head[0], base))
+					while (head < end && Char_Is(head[0], digit_class))
 						++head;
 					
 					token.kind = C_TokenKind_DoubleLiteral;
@@ -417,10 +745,7 @@ C_TokenizeForPreproc(C_TuContext* tu, Arena* output_arena, String source, C_Erro
 			case 's': case 't': case 'u': case 'v': case 'w': case 'x': case 'y': case 'z':
 			case '_': lbl_parse_ident:
 			{
-				do
-					++head;
-				while (head < end && C_IsIdentChar(head[0], false));
-				
+				head = Char_SkipIdent(head + 1, end);
 				token.kind = C_TokenKind_Identifier;
 			} break;
 			
@@ -645,28 +970,179 @@ C_TokenizeForPreproc(C_TuContext* tu, Arena* output_arena, String source, C_Erro
 				}
 			} break;
 			
+			// NOTE(ljre): Bytes that can't start any token are still valid preprocessing tokens on their
+			//             own, and skipped groups are allowed to have them.
 			default:
 			{
-				ok = false;
+				token.kind = C_TokenKind_Other;
+				++head;
 			} break;
 		}
 		
-		token.as_string = StrRange(token_begin, head);
+		TempToken temp = {
+			.str_offset = (uint32)(token_begin - begin),
+			.str_size = (uint32)(head - token_begin),
+			.leading_spaces = (uint16)Min(token.leading_spaces, UINT16_MAX),
+			.kind = (uint8)token.kind,
+		};
 		
-		C_PreprocTokenList node = { .tok = token };
+		Arena_PushStructData(temp_arena, TempToken, &temp);
+		++token_count;
+	}
+	
+	C_PreprocTokenArray* result = Arena_PushStruct(output_arena, C_PreprocTokenArray);
+	result->source = source;
+	result->size = token_count;
+	result->kinds = Arena_PushArray(output_arena, uint8, token_count);
+	result->leading_spaces = Arena_PushArray(output_arena, uint16, token_count);
+	result->str_offsets = Arena_PushArray(output_arena, uint32, token_count);
+	result->str_sizes = Arena_PushArray(output_arena, uint32, token_count);
+	
+	for (uint32 i = 0; i < token_count; ++i)
+	{
+		result->kinds[i] = temp_tokens[i].kind;
+		result->leading_spaces[i] = temp_tokens[i].leading_spaces;
+		result->str_offsets[i] = temp_tokens[i].str_offset;
+		result->str_sizes[i] = temp_tokens[i].str_size;
+	}
+	
+	C_InternTokenSymbols(tu, result, output_arena);
+	
+	if (temp_arena != output_arena)
+		Arena_Restore(temp_save);
+	
+	return result;
+}
+
+static inline C_PreprocToken
+C_GetPreprocToken(const C_PreprocTokenArray* array, uint32 index)
+{
+	Assert(index < array->size);
+	
+	C_PreprocToken result = {
+		.kind = array->kinds[index],
+		.leading_spaces = array->leading_spaces[index],
+		.symbol = array->symbols[index],
+		.as_string = StrMake(array->str_sizes[index], array->source.data + array->str_offsets[index]),
+	};
+	
+	return result;
+}
+
+//~ NOTE(ljre): Source locations
+// NOTE(ljre): 'arena' should live as long as 'file' does, since the index is shared with every other
+//             thread that looks at the same file.
+static const C_LineIndex*
+C_GetLineIndex(C_LoadedFile* file, Arena* arena)
+{
+	C_LineIndex* index = Atomic_LoadPtr((void* volatile*)&file->line_index);
+	if (index)
+		return index;
+	
+	String contents = file->contents;
+	uint32 count = 1 + (uint32)Mem_CountByte(contents.data, '\n', contents.size);
+	
+	uint8* arena_end = Arena_End(arena);
+	index = Arena_PushAligned(arena, sizeof(C_LineIndex) + sizeof(uint32) * count, alignof(C_LineIndex));
+	index->count = count;
+	index->starts[0] = 0;
+	
+	uint32 line = 1;
+	uint32 i = 0;
+	
+	// NOTE(ljre): XMM by XMM
+	{
+		__m128i linebreaks = _mm_set1_epi8('\n');
 		
-		*tok_head = Arena_PushStructData(output_arena, C_PreprocTokenList, &node);
-		tok_head = &(*tok_head)->next;
+		for (; i + 16 <= contents.size; i += 16)
+		{
+			__m128i data = _mm_loadu_si128((const __m128i*)(contents.data + i));
+			uint32 found = (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(data, linebreaks));
+			
+			for (; found; found &= found - 1)
+				index->starts[line++] = i + Mem_BitCtz32(found) + 1;
+		}
 	}
 	
-	if (!ok)
+	// NOTE(ljre): Byte by byte
+	for (; i < contents.size; ++i)
 	{
-		// TODO
-		Arena_Restore(arena_save);
+		if (contents.data[i] == '\n')
+			index->starts[line++] = i + 1;
+	}
+	
+	Assert(line == count);
+	
+	C_LineIndex* previous = Atomic_CompareExchangePtr((void* volatile*)&file->line_index, NULL, index);
+	if (previous)
+	{
+		Arena_Pop(arena, arena_end);
+		return previous;
+	}
+	
+	return index;
+}
+
+// NOTE(ljre): Both are 1-based, the same as the lexer's.
+static void
+C_LineColumnFromOffset(const C_LineIndex* index, uint32 offset, uint32* out_line, uint32* out_col)
+{
+	// NOTE(ljre): Last line that starts at or before 'offset'. The first one always does.
+	uint32 low = 0;
+	uint32 high = index->count;
+	
+	while (high - low > 1)
+	{
+		uint32 mid = low + (high - low) / 2;
+		
+		if (index->starts[mid] <= offset)
+			low = mid;
+		else
+			high = mid;
+	}
+	
+	*out_line = low + 1;
+	*out_col = offset - index->starts[low] + 1;
+}
+
+// NOTE(ljre): Follows expansions up to the outermost one, and returns where it was written in a file.
+static C_SourceLoc
+C_GetFileLoc(const C_LocTable* table, C_SourceLoc loc)
+{
+	while (loc & C_SOURCE_LOC_EXPANSION_BIT)
+		loc = table->expansions[loc & ~C_SOURCE_LOC_EXPANSION_BIT].expanded_from;
+	
+	return loc;
+}
+
+// NOTE(ljre): Returns the file entry containing a file location, or NULL for 0. Can be called from
+//             another thread while the table is being filled, for any location it was handed.
+static const C_LocFile*
+C_FindLocFile(C_LocTable* table, C_SourceLoc loc)
+{
+	Assert(!(loc & C_SOURCE_LOC_EXPANSION_BIT));
+	
+	uint32 count = Atomic_Load32(&table->file_count);
+	const C_LocFile* files = Atomic_LoadPtr((void* volatile*)&table->files);
+	
+	if (!loc || count == 0 || loc < files[0].base)
 		return NULL;
+	
+	// NOTE(ljre): Last file whose base is at or before 'loc'.
+	uint32 low = 0;
+	uint32 high = count;
+	
+	while (high - low > 1)
+	{
+		uint32 mid = low + (high - low) / 2;
+		
+		if (files[mid].base <= loc)
+			low = mid;
+		else
+			high = mid;
 	}
 	
-	return result;
+	return &files[low];
 }
 
 //~ NOTE(ljre): Utils
@@ -720,7 +1196,7 @@ C_TokenizeFloat(Arena* scratch_arena, String str, float64* out_value)
 
 static String
 C_TokenAsString(C_Token tok)
-{ return StrMake(tok.str_size, tok.str_data); }
+{ return StrMake(((const uint32*)tok.str_data)[-1], tok.str_data); }
 
 static String
 C_TokenKindAsString(C_TokenKind kind)
@@ -803,6 +1279,7 @@ C_TokenKindAsString(C_TokenKind kind)
 		case C_TokenKind_Identifier: s = Str("(identifier)"); break;
 		
 		case C_TokenKind_UnclosedQuote: s = Str("(unclosed quote)"); break;
+		case C_TokenKind_Other: s = Str("(stray character)"); break;
 		
 		case C_TokenKind_LeftParen: s = Str("("); break;
 		case C_TokenKind_RightParen: s = Str(")"); break;
@@ -0,0 +1,192 @@
+//~ NOTE(ljre): Persistent token cache
+//
+// Headers found through the include dirs are tokenized once and their tokens are written to
+// '<cache dir>/<path hash>.tok'. Next time the same header is loaded (by any process) and its size and
+// modification time still match, the cache file is mapped and its arrays are used directly as the
+// file's C_PreprocTokenArray, without running the lexer.
+//
+// Token strings are stored as offsets into the source file, so the cache file has no pointers in it
+// and is position independent. A cache file is written to a temporary name first and then renamed
+// over the old one, so concurrent compilers never see a half-written file.
+
+#define C_TOKEN_CACHE_MAGIC 0x6b6f7450 // "Ptok"
+#define C_TOKEN_CACHE_VERSION 5
+
+struct C_TokenCacheHeader
+{
+	uint32 magic;
+	uint32 version;
+	
+	uint64 source_size;
+	uint64 source_modified_time;
+	
+	uint32 path_size;
+	uint32 token_count;
+	
+	// NOTE(ljre): Followed by 'path_size' bytes of the source path, then by each array of the
+	//             C_PreprocTokenArray. Everything starts at an 8 byte boundary.
+}
+typedef C_TokenCacheHeader;
+
+struct C_TokenCacheLayout
+{
+	uintsize path;
+	uintsize str_offsets;
+	uintsize str_sizes;
+	uintsize leading_spaces;
+	uintsize kinds;
+	uintsize total_size;
+}
+typedef C_TokenCacheLayout;
+
+static inline C_TokenCacheLayout
+C_TokenCacheLayoutFor(uint32 path_size, uint32 token_count)
+{
+	C_TokenCacheLayout layout;
+	uintsize offset = sizeof(C_TokenCacheHeader);
+	
+	layout.path = offset;
+	offset = AlignUp(offset + path_size, 7);
+	layout.str_offsets = offset;
+	offset = AlignUp(offset + sizeof(uint32) * token_count, 7);
+	layout.str_sizes = offset;
+	offset = AlignUp(offset + sizeof(uint32) * token_count, 7);
+	layout.leading_spaces = offset;
+	offset = AlignUp(offset + sizeof(uint16) * token_count, 7);
+	layout.kinds = offset;
+	offset = AlignUp(offset + sizeof(uint8) * token_count, 7);
+	layout.total_size = offset;
+	
+	return layout;
+}
+
+static inline String
+C_TokenCacheFilePath(Arena* arena, String cache_dir, uint64 path_hash)
+{
+	return Arena_Printf(arena, "%S/%X.tok", cache_dir, path_hash);
+}
+
+static C_PreprocTokenArray*
+C_LoadTokenCacheFromFile(C_TuContext* tu, Arena* output_arena, String path, uint64 path_hash, String contents)
+{
+	Arena* scratch_arena = tu->scratch_arena;
+	
+	OS_FileInfo info;
+	if (!OS_GetFileInfo(path, &info, scratch_arena, NULL) || info.size != contents.size)
+		return NULL;
+	
+	// NOTE(ljre): The arrays are used in place, so the cache file has to live as long as the source.
+	String cache_path = C_TokenCacheFilePath(scratch_arena, tu->options->token_cache_dir, path_hash);
+	uint8* output_end = Arena_EndAligned(output_arena, 8);
+	String data;
+	
+	if (!OS_ReadWholeFile(cache_path, &data, output_arena, NULL))
+		return NULL;
+	
+	// NOTE(ljre): The arrays are also used as they are, so they need to be aligned. A mapped file always
+	//             is, and a file read into the arena starts at its aligned end, but don't count on either.
+	if ((uintptr)data.data & 7)
+		data.data = Arena_PushMemoryAligned(output_arena, data.data, data.size, 8);
+	
+	C_TokenCacheHeader header = { 0 };
+	if (data.size >= sizeof(header))
+		Mem_Copy(&header, data.data, sizeof(header));
+	
+	C_TokenCacheLayout layout = C_TokenCacheLayoutFor(header.path_size, header.token_count);
+	
+	// NOTE(ljre): Different paths might collide in the hash.
+	if (header.magic != C_TOKEN_CACHE_MAGIC ||
+		header.version != C_TOKEN_CACHE_VERSION ||
+		header.source_size != info.size ||
+		header.source_modified_time != info.modified_time ||
+		header.path_size > data.size ||
+		header.token_count > data.size ||
+		layout.total_size != data.size ||
+		!String_Equals(path, StrMake(header.path_size, data.data + layout.path)))
+	{
+		Arena_Pop(output_arena, output_end);
+		return NULL;
+	}
+	
+	C_PreprocTokenArray* result = Arena_PushStruct(output_arena, C_PreprocTokenArray);
+	result->source = contents;
+	result->size = header.token_count;
+	result->kinds = (uint8*)(data.data + layout.kinds);
+	result->leading_spaces = (uint16*)(data.data + layout.leading_spaces);
+	result->str_offsets = (uint32*)(data.data + layout.str_offsets);
+	result->str_sizes = (uint32*)(data.data + layout.str_sizes);
+	
+	for (uint32 i = 0; i < result->size; ++i)
+	{
+		if (result->kinds[i] >= C_TokenKind__Count ||
+			result->str_offsets[i] > contents.size ||
+			result->str_sizes[i] > contents.size - result->str_offsets[i])
+		{
+			Arena_Pop(output_arena, output_end);
+			return NULL;
+		}
+	}
+	
+	// NOTE(ljre): Symbol IDs are only meaningful inside this process, so they're never stored.
+	C_InternTokenSymbols(tu, result, output_arena);
+	
+	return result;
+}
+
+// NOTE(ljre): Returns NULL if there's no valid cache file for this source. 'contents' should be the
+//             source file exactly as it is now, since tokens point into it.
+static C_PreprocTokenArray*
+C_LoadTokenCache(C_TuContext* tu, Arena* output_arena, String path, uint64 path_hash, String contents)
+{
+	C_PreprocTokenArray* result = NULL;
+	
+	for Arena_TempScope(tu->scratch_arena)
+		result = C_LoadTokenCacheFromFile(tu, output_arena, path, path_hash, contents);
+	
+	return result;
+}
+
+static void
+C_SaveTokenCacheToFile(C_TuContext* tu, String path, uint64 path_hash, const C_PreprocTokenArray* tokens)
+{
+	Arena* scratch_arena = tu->scratch_arena;
+	
+	OS_FileInfo info;
+	if (!OS_GetFileInfo(path, &info, scratch_arena, NULL) || info.size != tokens->source.size)
+		return;
+	
+	C_TokenCacheHeader header = {
+		.magic = C_TOKEN_CACHE_MAGIC,
+		.version = C_TOKEN_CACHE_VERSION,
+		.source_size = info.size,
+		.source_modified_time = info.modified_time,
+		.path_size = (uint32)path.size,
+		.token_count = tokens->size,
+	};
+	
+	C_TokenCacheLayout layout = C_TokenCacheLayoutFor(header.path_size, header.token_count);
+	uint8* data = Arena_PushAligned(scratch_arena, layout.total_size, 8);
+	uint32 count = tokens->size;
+	
+	Mem_Copy(data, &header, sizeof(header));
+	Mem_Copy(data + layout.path, path.data, path.size);
+	Mem_Copy(data + layout.str_offsets, tokens->str_offsets, sizeof(uint32) * count);
+	Mem_Copy(data + layout.str_sizes, tokens->str_sizes, sizeof(uint32) * count);
+	Mem_Copy(data + layout.leading_spaces, tokens->leading_spaces, sizeof(uint16) * count);
+	Mem_Copy(data + layout.kinds, tokens->kinds, sizeof(uint8) * count);
+	
+	// NOTE(ljre): The cache arena's address is unique per worker, and the process ID is unique per
+	//             compiler sharing the cache dir, so together they make a unique temp name.
+	String cache_path = C_TokenCacheFilePath(scratch_arena, tu->options->token_cache_dir, path_hash);
+	String temp_path = Arena_Printf(scratch_arena, "%S.%x.%X", cache_path, OS_GetProcessId(), (uint64)(uintptr)tu->cache_arena);
+	
+	if (OS_WriteWholeFile(temp_path, StrMake(layout.total_size, data), scratch_arena, NULL))
+		OS_RenameFile(temp_path, cache_path, scratch_arena, NULL);
+}
+
+static void
+C_SaveTokenCache(C_TuContext* tu, String path, uint64 path_hash, const C_PreprocTokenArray* tokens)
+{
+	for Arena_TempScope(tu->scratch_arena)
+		C_SaveTokenCacheToFile(tu, path, path_hash, tokens);
+}
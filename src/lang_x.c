@@ -50,6 +50,8 @@ X_Main(int32 argc, const char* const* argv)
 	
 	// NOTE(ljre): Tokenize source file
 	{
+		X_InitKeywordTable();
+		
 		X_TokenizeString_Error tokenize_err;
 		Allocators allocators = {
 			.output_arena = output_arena,
@@ -8,7 +8,7 @@ X_IgnoreWhitespacesLeft(const uint8** phead, const uint8* end)
 	
 	while (head < end && head[0])
 	{
-		if (head[0] != ' ' && head[0] != '\t' && head[0] != '\r' && head[0] != '\n')
+		if (!Char_Is(head[0], Char_Blank | Char_LineBreak))
 			break;
 		
 		++head;
@@ -22,57 +22,45 @@ X_IgnoreWhitespacesLeft(const uint8** phead, const uint8* end)
 
 static bool
 X_IsCharValidIdent(char ch, bool first)
-{
-	bool result = (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch == '_');
-	
-	if (!first)
-		result = result || (ch >= '0' && ch <= '9');
-	
-	return result;
-}
+{ return Char_Is((uint8)ch, first ? Char_IdentStart : Char_Ident); }
 
-static X_TokenKind
-X_FindKeywordByName(String ident)
+static Hash_KeywordTable X_keyword_table;
+
+// NOTE(ljre): Must be called once before tokenizing anything.
+static void
+X_InitKeywordTable(void)
 {
-	int32 left = X_TokenKind__FirstKeyword;
-	int32 right = X_TokenKind__LastKeyword + 1;
+	String names[X_TokenKind__LastKeyword - X_TokenKind__FirstKeyword + 1];
+	uint8 kinds[ArrayLength(names)];
 	
-	while (left < right)
+	for (int32 i = 0; i < ArrayLength(names); ++i)
 	{
-		int32 i = (left + right) / 2;
-		int32 cmp = String_Compare(ident, X_token_str_table[i]);
-		
-		if (cmp < 0)
-			right = i;
-		else if (cmp > 0)
-			left = i + 1;
-		else
-			return i;
+		names[i] = X_token_str_table[X_TokenKind__FirstKeyword + i];
+		kinds[i] = (uint8)(X_TokenKind__FirstKeyword + i);
 	}
 	
-	return X_TokenKind_Null;
+	bool ok = Hash_BuildKeywordTable(&X_keyword_table, names, kinds, ArrayLength(names));
+	SafeAssert(ok);
 }
 
+static X_TokenKind
+X_FindKeywordByName(String ident)
+{ return (X_TokenKind)Hash_FindKeyword(&X_keyword_table, ident); }
+
 static void
 X_GetLineColumnFromOffset(String source, uintsize offset, uint32* restrict out_line, uint32* restrict out_col)
 {
 	Assert(offset <= source.size);
 	
-	uint32 line = 1;
-	uint32 col = 1;
+	// NOTE(ljre): Only called for errors, so there's no line index to search. Counting line feeds is
+	//             vectorized, and the column is just how far back the last one is.
+	uintsize line_begin = offset;
 	
-	for (uintsize i = 0; i < offset; ++i)
-	{
-		switch (source.data[i])
-		{
-			case '\n': ++line;
-			case '\r': col = 1; break;
-			default: ++col; break;
-		}
-	}
+	while (line_begin > 0 && source.data[line_begin-1] != '\n')
+		--line_begin;
 	
-	*out_line = line;
-	*out_col = col;
+	*out_line = 1 + (uint32)Mem_CountByte(source.data, '\n', line_begin);
+	*out_col = 1 + (uint32)(offset - line_begin);
 }
 
 struct X_TokenizeString_Error
@@ -115,9 +103,7 @@ X_TokenizeString(String source, const Allocators* allocators, X_TokenizeString_E
 		
 		if (X_IsCharValidIdent(head[0], true))
 		{
-			do
-				++head;
-			while (head < end && X_IsCharValidIdent(head[0], false));
+			head = Char_SkipIdent(head + 1, end);
 			
 			token.kind = X_TokenKind_Ident;
 			
@@ -130,11 +116,11 @@ X_TokenizeString(String source, const Allocators* allocators, X_TokenizeString_E
 			if (as_keyword)
 				token.kind = as_keyword;
 		}
-		else if (head[0] >= '0' && head[0] <= '9')
+		else if (Char_Is(head[0], Char_Digit))
 		{
 			do
 				++head;
-			while (head < end && head[0] >= '0' && head[0] <= '9');
+			while (head < end && Char_Is(head[0], Char_Digit));
 			
 			token.kind = X_TokenKind_NumberLiteral;
 		}
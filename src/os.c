@@ -1,12 +1,29 @@
 #include "internal.h"
 
-#ifndef _WIN32
-#   error ooonly win32 for now
-#endif
+// NOTE(ljre): Used by OS_ListDirectory. 'names' is 'count' null-terminated strings, one after the other.
+static String*
+MakeNameArray(Arena* arena, const uint8* names, uintsize count)
+{
+	String* result = Arena_PushArray(arena, String, count);
+	const uint8* head = names;
+	
+	for (uintsize i = 0; i < count; ++i)
+	{
+		uintsize size = Mem_Strlen((const char*)head);
+		result[i] = StrMake(size, head);
+		head += size + 1;
+	}
+	
+	return result;
+}
 
+#if defined(_WIN32)
+//~ NOTE(ljre): Win32 backend
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
+#pragma comment(lib, "synchronization.lib")
+
 static bool
 SetErrorInfo(OS_Error* out_err)
 {
@@ -142,6 +159,154 @@ OS_WriteWholeFile(String path, String data, Arena* scratch_arena, OS_Error* out_
 	return result;
 }
 
+API bool
+OS_GetFileInfo(String path, OS_FileInfo* out_info, Arena* scratch_arena, OS_Error* out_err)
+{
+	char* arena_end = Arena_End(scratch_arena);
+	
+	int32 wpath_len = MultiByteToWideChar(CP_UTF8, 0, (const char*)path.data, path.size, NULL, 0) + 1;
+	if (wpath_len <= 0)
+		return SetErrorInfo(out_err);
+	
+	wchar_t* wpath = Arena_PushDirtyAligned(scratch_arena, wpath_len * sizeof(*wpath), 2);
+	MultiByteToWideChar(CP_UTF8, 0, (const char*)path.data, path.size, wpath, wpath_len);
+	wpath[wpath_len-1] = 0;
+	
+	// NOTE(ljre): Only a handle gives us the file index, attributes alone are not enough.
+	DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+	HANDLE handle = CreateFileW(wpath, FILE_READ_ATTRIBUTES, share, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+	Arena_Pop(scratch_arena, arena_end);
+	
+	if (handle == INVALID_HANDLE_VALUE)
+		return SetErrorInfo(out_err);
+	
+	BY_HANDLE_FILE_INFORMATION data;
+	if (!GetFileInformationByHandle(handle, &data))
+	{
+		CloseHandle(handle);
+		return SetErrorInfo(out_err);
+	}
+	
+	CloseHandle(handle);
+	
+	// NOTE(ljre): FILETIME counts from 1601, we want 1970.
+	uint64 filetime = data.ftLastWriteTime.dwLowDateTime | (uint64)data.ftLastWriteTime.dwHighDateTime << 32;
+	
+	out_info->size = data.nFileSizeLow | (uint64)data.nFileSizeHigh << 32;
+	out_info->modified_time = filetime - 116444736000000000ull;
+	out_info->device = data.dwVolumeSerialNumber;
+	out_info->inode = data.nFileIndexLow | (uint64)data.nFileIndexHigh << 32;
+	
+	return SetErrorInfo(out_err);
+}
+
+API bool
+OS_RenameFile(String from, String to, Arena* scratch_arena, OS_Error* out_err)
+{
+	char* arena_end = Arena_End(scratch_arena);
+	
+	int32 wfrom_len = MultiByteToWideChar(CP_UTF8, 0, (const char*)from.data, from.size, NULL, 0) + 1;
+	int32 wto_len = MultiByteToWideChar(CP_UTF8, 0, (const char*)to.data, to.size, NULL, 0) + 1;
+	if (wfrom_len <= 0 || wto_len <= 0)
+		return SetErrorInfo(out_err);
+	
+	wchar_t* wfrom = Arena_PushDirtyAligned(scratch_arena, wfrom_len * sizeof(*wfrom), 2);
+	MultiByteToWideChar(CP_UTF8, 0, (const char*)from.data, from.size, wfrom, wfrom_len);
+	wfrom[wfrom_len-1] = 0;
+	
+	wchar_t* wto = Arena_PushDirtyAligned(scratch_arena, wto_len * sizeof(*wto), 2);
+	MultiByteToWideChar(CP_UTF8, 0, (const char*)to.data, to.size, wto, wto_len);
+	wto[wto_len-1] = 0;
+	
+	MoveFileExW(wfrom, wto, MOVEFILE_REPLACE_EXISTING);
+	Arena_Pop(scratch_arena, arena_end);
+	
+	return SetErrorInfo(out_err);
+}
+
+API bool
+OS_CreateDirectory(String path, Arena* scratch_arena, OS_Error* out_err)
+{
+	char* arena_end = Arena_End(scratch_arena);
+	
+	int32 wpath_len = MultiByteToWideChar(CP_UTF8, 0, (const char*)path.data, path.size, NULL, 0) + 1;
+	if (wpath_len <= 0)
+		return SetErrorInfo(out_err);
+	
+	wchar_t* wpath = Arena_PushDirtyAligned(scratch_arena, wpath_len * sizeof(*wpath), 2);
+	MultiByteToWideChar(CP_UTF8, 0, (const char*)path.data, path.size, wpath, wpath_len);
+	wpath[wpath_len-1] = 0;
+	
+	if (CreateDirectoryW(wpath, NULL))
+		SetLastError(ERROR_SUCCESS);
+	else if (GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		DWORD attributes = GetFileAttributesW(wpath);
+		
+		if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+			SetLastError(ERROR_SUCCESS);
+		else
+			SetLastError(ERROR_FILE_EXISTS);
+	}
+	
+	Arena_Pop(scratch_arena, arena_end);
+	
+	return SetErrorInfo(out_err);
+}
+
+API bool
+OS_ListDirectory(String path, String** out_names, uintsize* out_count, Arena* output_arena, OS_Error* out_err)
+{
+	uint8* arena_end = Arena_End(output_arena);
+	*out_names = NULL;
+	*out_count = 0;
+	
+	// NOTE(ljre): FindFirstFileW wants a pattern, so append "\*".
+	int32 wpath_len = MultiByteToWideChar(CP_UTF8, 0, (const char*)path.data, path.size, NULL, 0) + 3;
+	if (wpath_len <= 3)
+		return SetErrorInfo(out_err);
+	
+	wchar_t* wpath = Arena_PushDirtyAligned(output_arena, wpath_len * sizeof(*wpath), 2);
+	MultiByteToWideChar(CP_UTF8, 0, (const char*)path.data, path.size, wpath, wpath_len);
+	wpath[wpath_len-3] = '\\';
+	wpath[wpath_len-2] = '*';
+	wpath[wpath_len-1] = 0;
+	
+	WIN32_FIND_DATAW data;
+	HANDLE find = FindFirstFileW(wpath, &data);
+	Arena_Pop(output_arena, arena_end);
+	
+	if (find == INVALID_HANDLE_VALUE)
+		return SetErrorInfo(out_err);
+	
+	const uint8* names = Arena_End(output_arena);
+	uintsize count = 0;
+	
+	do
+	{
+		const wchar_t* name = data.cFileName;
+		if (name[0] == '.' && (name[1] == 0 || name[1] == '.' && name[2] == 0))
+			continue;
+		
+		int32 size = WideCharToMultiByte(CP_UTF8, 0, name, -1, NULL, 0, NULL, NULL);
+		if (size <= 0)
+			continue;
+		
+		char* buf = Arena_PushDirtyAligned(output_arena, size, 1);
+		WideCharToMultiByte(CP_UTF8, 0, name, -1, buf, size, NULL, NULL);
+		++count;
+	}
+	while (FindNextFileW(find, &data));
+	
+	FindClose(find);
+	
+	*out_names = MakeNameArray(output_arena, names, count);
+	*out_count = count;
+	
+	SetLastError(ERROR_SUCCESS);
+	return SetErrorInfo(out_err);
+}
+
 API uint64
 OS_GetPosixTimestamp(void)
 {
@@ -211,6 +376,554 @@ OS_ResolveFullPath(String path, Arena* output_arena, OS_Error* out_err)
 	return StrMake(fullpath_len, base);
 }
 
+API bool
+OS_PrintStderr(String data, Arena* scratch_arena, OS_Error* out_err)
+{
+	Mem_Set(out_err, 0, sizeof(*out_err));
+	out_err->ok = true;
+	
+	return PrintToFile(data, out_err, GetStdHandle(STD_ERROR_HANDLE));
+}
+
+API bool
+OS_PrintStdout(String data, Arena* scratch_arena, OS_Error* out_err)
+{
+	Mem_Set(out_err, 0, sizeof(*out_err));
+	out_err->ok = true;
+	
+	return PrintToFile(data, out_err, GetStdHandle(STD_OUTPUT_HANDLE));
+}
+
+API bool
+OS_OpenFileForWriting(String path, OS_File* out_file, Arena* scratch_arena, OS_Error* out_err)
+{
+	char* arena_end = Arena_End(scratch_arena);
+	
+	int32 wpath_len = MultiByteToWideChar(CP_UTF8, 0, (const char*)path.data, path.size, NULL, 0) + 1;
+	if (wpath_len <= 0)
+		return SetErrorInfo(out_err);
+	
+	wchar_t* wpath = Arena_PushDirtyAligned(scratch_arena, wpath_len * sizeof(*wpath), 2);
+	MultiByteToWideChar(CP_UTF8, 0, (const char*)path.data, path.size, wpath, wpath_len);
+	wpath[wpath_len-1] = 0;
+	
+	HANDLE file = CreateFileW(wpath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+	Arena_Pop(scratch_arena, arena_end);
+	
+	if (file == INVALID_HANDLE_VALUE)
+		return SetErrorInfo(out_err);
+	
+	out_file->handle = (uintptr)file;
+	return SetErrorInfo(out_err);
+}
+
+API OS_File
+OS_GetStdout(void)
+{
+	return (OS_File) { (uintptr)GetStdHandle(STD_OUTPUT_HANDLE) };
+}
+
+API bool
+OS_WriteFile(OS_File file, String data, OS_Error* out_err)
+{
+	return PrintToFile(data, out_err, (HANDLE)file.handle);
+}
+
+API void
+OS_CloseFile(OS_File file)
+{
+	if ((HANDLE)file.handle != GetStdHandle(STD_OUTPUT_HANDLE))
+		CloseHandle((HANDLE)file.handle);
+}
+
+static DWORD WINAPI
+ThreadProcWrapper(void* arg)
+{
+	OS_Thread* thread = arg;
+	return (DWORD)thread->proc(thread->user_data);
+}
+
+API bool
+OS_CreateThread(OS_Thread* thread, OS_ThreadProc* proc, void* user_data, OS_Error* out_err)
+{
+	thread->proc = proc;
+	thread->user_data = user_data;
+	
+	HANDLE handle = CreateThread(NULL, 0, ThreadProcWrapper, thread, 0, NULL);
+	if (!handle)
+		return SetErrorInfo(out_err);
+	
+	thread->handle = (uintptr)handle;
+	return SetErrorInfo(out_err);
+}
+
+API int32
+OS_JoinThread(OS_Thread* thread)
+{
+	HANDLE handle = (HANDLE)thread->handle;
+	DWORD exit_code = 0;
+	
+	WaitForSingleObject(handle, INFINITE);
+	GetExitCodeThread(handle, &exit_code);
+	CloseHandle(handle);
+	
+	return (int32)exit_code;
+}
+
+API void
+OS_WaitOnAddress(volatile uint32* address, uint32 value)
+{
+	WaitOnAddress(address, &value, sizeof(value), INFINITE);
+}
+
+API void
+OS_WakeAllOnAddress(volatile uint32* address)
+{
+	WakeByAddressAll((void*)address);
+}
+
+API int32
+OS_GetProcessorCount(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	
+	return (int32)info.dwNumberOfProcessors;
+}
+
+API uint32
+OS_GetProcessId(void)
+{
+	return (uint32)GetCurrentProcessId();
+}
+
+#elif defined(__linux__)
+//~ NOTE(ljre): Linux backend
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <dirent.h>
+
+static bool
+SetErrorInfo(OS_Error* out_err, int32 code)
+{
+	bool ok = (code == 0);
+	
+	if (!out_err)
+		return ok;
+	
+	out_err->code = (uint32)code;
+	out_err->ok = ok;
+	
+	switch (code)
+	{
+		case 0: out_err->why = Str("no error"); break;
+		case ENOENT: out_err->why = Str("file not found"); break;
+		case EACCES: out_err->why = Str("access denied"); break;
+		case EPERM: out_err->why = Str("access denied"); break;
+		case EEXIST: out_err->why = Str("file already exists"); break;
+		case ENOSPC: out_err->why = Str("disk is full"); break;
+		case EISDIR: out_err->why = Str("path is a directory"); break;
+		default: out_err->why = Str("unknown error"); break;
+	}
+	
+	return ok;
+}
+
+static bool
+PrintToFile(String data, OS_Error* out_err, int32 fd)
+{
+	uintsize size = data.size;
+	const uint8* head = data.data;
+	
+	while (size > 0)
+	{
+		intsize bytes_written = write(fd, head, size);
+		
+		if (bytes_written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			
+			return SetErrorInfo(out_err, errno);
+		}
+		
+		size -= bytes_written;
+		head += bytes_written;
+	}
+	
+	return SetErrorInfo(out_err, 0);
+}
+
+//~ OS API
+API bool
+OS_ReadWholeFile(String path, String* out_data, Arena* out_arena, OS_Error* out_err)
+{
+	// NOTE(ljre): The file is mapped with MAP_PRIVATE instead of being copied into 'out_arena', which is
+	//             only used to hold the null-terminated path. Pages get faulted in as they're touched and
+	//             the mapping is never unmapped: loaded files live for the whole run anyway.
+	uint8* arena_end = Arena_End(out_arena);
+	const char* cpath = Arena_PushCString(out_arena, path);
+	
+	int32 fd = open(cpath, O_RDONLY | O_CLOEXEC);
+	Arena_Pop(out_arena, arena_end);
+	
+	if (fd == -1)
+		return SetErrorInfo(out_err, errno);
+	
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+	{
+		int32 code = errno;
+		close(fd);
+		return SetErrorInfo(out_err, code);
+	}
+	
+	if (S_ISDIR(st.st_mode))
+	{
+		close(fd);
+		return SetErrorInfo(out_err, EISDIR);
+	}
+	
+	uintsize file_size = (uintsize)st.st_size;
+	const uint8* file_data = NULL;
+	
+	// NOTE(ljre): mmap() fails for zero-sized mappings, so an empty file is just an empty string.
+	if (file_size > 0)
+	{
+		void* mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		
+		if (mapping == MAP_FAILED)
+		{
+			int32 code = errno;
+			close(fd);
+			return SetErrorInfo(out_err, code);
+		}
+		
+		file_data = (const uint8*)mapping;
+	}
+	
+	close(fd);
+	
+	out_data->size = file_size;
+	out_data->data = file_data;
+	
+	return SetErrorInfo(out_err, 0);
+}
+
+API bool
+OS_WriteWholeFile(String path, String data, Arena* scratch_arena, OS_Error* out_err)
+{
+	char* arena_end = Arena_End(scratch_arena);
+	const char* cpath = Arena_PushCString(scratch_arena, path);
+	
+	bool result = true;
+	int32 fd = open(cpath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	
+	if (fd == -1)
+		result = SetErrorInfo(out_err, errno);
+	else
+	{
+		result = PrintToFile(data, out_err, fd);
+		close(fd);
+	}
+	
+	Arena_Pop(scratch_arena, arena_end);
+	return result;
+}
+
+API bool
+OS_GetFileInfo(String path, OS_FileInfo* out_info, Arena* scratch_arena, OS_Error* out_err)
+{
+	char* arena_end = Arena_End(scratch_arena);
+	const char* cpath = Arena_PushCString(scratch_arena, path);
+	
+	struct stat st;
+	int32 result = stat(cpath, &st);
+	Arena_Pop(scratch_arena, arena_end);
+	
+	if (result == -1)
+		return SetErrorInfo(out_err, errno);
+	
+	out_info->size = (uint64)st.st_size;
+	out_info->modified_time = (uint64)st.st_mtim.tv_sec * 10000000 + (uint64)st.st_mtim.tv_nsec / 100;
+	out_info->device = (uint64)st.st_dev;
+	out_info->inode = (uint64)st.st_ino;
+	
+	return SetErrorInfo(out_err, 0);
+}
+
+API bool
+OS_RenameFile(String from, String to, Arena* scratch_arena, OS_Error* out_err)
+{
+	char* arena_end = Arena_End(scratch_arena);
+	const char* cfrom = Arena_PushCString(scratch_arena, from);
+	const char* cto = Arena_PushCString(scratch_arena, to);
+	
+	int32 result = rename(cfrom, cto);
+	Arena_Pop(scratch_arena, arena_end);
+	
+	if (result == -1)
+		return SetErrorInfo(out_err, errno);
+	
+	return SetErrorInfo(out_err, 0);
+}
+
+API bool
+OS_CreateDirectory(String path, Arena* scratch_arena, OS_Error* out_err)
+{
+	char* arena_end = Arena_End(scratch_arena);
+	const char* cpath = Arena_PushCString(scratch_arena, path);
+	int32 code = 0;
+	
+	if (mkdir(cpath, 0777) == -1)
+	{
+		code = errno;
+		
+		struct stat st;
+		if (code == EEXIST && stat(cpath, &st) == 0 && S_ISDIR(st.st_mode))
+			code = 0;
+	}
+	
+	Arena_Pop(scratch_arena, arena_end);
+	
+	return SetErrorInfo(out_err, code);
+}
+
+API bool
+OS_ListDirectory(String path, String** out_names, uintsize* out_count, Arena* output_arena, OS_Error* out_err)
+{
+	uint8* arena_end = Arena_End(output_arena);
+	const char* cpath = Arena_PushCString(output_arena, path);
+	*out_names = NULL;
+	*out_count = 0;
+	
+	DIR* dir = opendir(cpath);
+	Arena_Pop(output_arena, arena_end);
+	
+	if (!dir)
+		return SetErrorInfo(out_err, errno);
+	
+	const uint8* names = Arena_End(output_arena);
+	uintsize count = 0;
+	struct dirent* entry;
+	
+	while ((entry = readdir(dir)))
+	{
+		const char* name = entry->d_name;
+		if (name[0] == '.' && (name[1] == 0 || name[1] == '.' && name[2] == 0))
+			continue;
+		
+		Arena_PushMemory(output_arena, name, Mem_Strlen(name) + 1);
+		++count;
+	}
+	
+	closedir(dir);
+	
+	*out_names = MakeNameArray(output_arena, names, count);
+	*out_count = count;
+	
+	return SetErrorInfo(out_err, 0);
+}
+
+API uint64
+OS_GetPosixTimestamp(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	
+	// NOTE(ljre): Same unit as the win32 backend (FILETIME): 100-nanosecond intervals.
+	uint64 result = 0;
+	result += (uint64)ts.tv_sec * 10000000;
+	result += (uint64)ts.tv_nsec / 100;
+	
+	return result;
+}
+
+API String
+OS_ResolveFullPath(String path, Arena* output_arena, OS_Error* out_err)
+{
+	if (out_err)
+	{
+		Mem_Set(out_err, 0, sizeof(*out_err));
+		out_err->ok = true;
+	}
+	
+	uint8* base = Arena_End(output_arena);
+	
+	// NOTE(ljre): Like GetFullPathNameW, this doesn't touch the file system other than for the current
+	//             working directory: symlinks aren't resolved and the path doesn't need to exist.
+	if (path.size == 0 || path.data[0] != '/')
+	{
+		char* cwd = Arena_PushDirtyAligned(output_arena, 4096, 1);
+		
+		if (!getcwd(cwd, 4096))
+		{
+			Arena_Pop(output_arena, base);
+			SetErrorInfo(out_err, errno);
+			return StrNull;
+		}
+		
+		Arena_Pop(output_arena, cwd + Mem_Strlen(cwd));
+		Arena_PushString(output_arena, Str("/"));
+	}
+	
+	Arena_PushString(output_arena, path);
+	
+	const uint8* read = base;
+	const uint8* const end = Arena_End(output_arena);
+	uint8* write = base;
+	
+	while (read < end)
+	{
+		const uint8* segment = read;
+		while (read < end && *read != '/')
+			++read;
+		
+		uintsize segment_size = read - segment;
+		if (read < end)
+			++read;
+		
+		if (segment_size == 0 || segment_size == 1 && segment[0] == '.')
+			continue;
+		
+		if (segment_size == 2 && segment[0] == '.' && segment[1] == '.')
+		{
+			while (write > base && write[-1] != '/')
+				--write;
+			if (write > base)
+				--write;
+			
+			continue;
+		}
+		
+		*write++ = '/';
+		Mem_Move(write, segment, segment_size);
+		write += segment_size;
+	}
+	
+	if (write == base)
+		*write++ = '/';
+	
+	Arena_Pop(output_arena, write);
+	return StrRange(base, write);
+}
+
+API bool
+OS_PrintStderr(String data, Arena* scratch_arena, OS_Error* out_err)
+{
+	return PrintToFile(data, out_err, STDERR_FILENO);
+}
+
+API bool
+OS_PrintStdout(String data, Arena* scratch_arena, OS_Error* out_err)
+{
+	return PrintToFile(data, out_err, STDOUT_FILENO);
+}
+
+API bool
+OS_OpenFileForWriting(String path, OS_File* out_file, Arena* scratch_arena, OS_Error* out_err)
+{
+	char* arena_end = Arena_End(scratch_arena);
+	const char* cpath = Arena_PushCString(scratch_arena, path);
+	
+	int32 fd = open(cpath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	Arena_Pop(scratch_arena, arena_end);
+	
+	if (fd == -1)
+		return SetErrorInfo(out_err, errno);
+	
+	out_file->handle = (uintptr)fd;
+	return SetErrorInfo(out_err, 0);
+}
+
+API OS_File
+OS_GetStdout(void)
+{
+	return (OS_File) { STDOUT_FILENO };
+}
+
+API bool
+OS_WriteFile(OS_File file, String data, OS_Error* out_err)
+{
+	return PrintToFile(data, out_err, (int32)file.handle);
+}
+
+API void
+OS_CloseFile(OS_File file)
+{
+	if ((int32)file.handle != STDOUT_FILENO)
+		close((int32)file.handle);
+}
+
+static void*
+ThreadProcWrapper(void* arg)
+{
+	OS_Thread* thread = arg;
+	return (void*)(intptr)thread->proc(thread->user_data);
+}
+
+API bool
+OS_CreateThread(OS_Thread* thread, OS_ThreadProc* proc, void* user_data, OS_Error* out_err)
+{
+	thread->proc = proc;
+	thread->user_data = user_data;
+	
+	pthread_t handle;
+	int32 code = pthread_create(&handle, NULL, ThreadProcWrapper, thread);
+	if (code != 0)
+		return SetErrorInfo(out_err, code);
+	
+	thread->handle = (uintptr)handle;
+	return SetErrorInfo(out_err, 0);
+}
+
+API int32
+OS_JoinThread(OS_Thread* thread)
+{
+	void* exit_code = NULL;
+	pthread_join((pthread_t)thread->handle, &exit_code);
+	
+	return (int32)(intptr)exit_code;
+}
+
+API void
+OS_WaitOnAddress(volatile uint32* address, uint32 value)
+{
+	syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+API void
+OS_WakeAllOnAddress(volatile uint32* address)
+{
+	syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+}
+
+API int32
+OS_GetProcessorCount(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (int32)count : 1;
+}
+
+API uint32
+OS_GetProcessId(void)
+{
+	return (uint32)getpid();
+}
+
+#else
+#   error unsupported platform
+#endif
+
+//~ NOTE(ljre): Platform-independent
 API void
 OS_SplitPath(String fullpath, String* out_folder, String* out_file)
 {
@@ -232,21 +945,3 @@ OS_SplitPath(String fullpath, String* out_folder, String* out_file)
 	if (out_file)
 		*out_file = file;
 }
-
-API bool
-OS_PrintStderr(String data, Arena* scratch_arena, OS_Error* out_err)
-{
-	Mem_Set(out_err, 0, sizeof(*out_err));
-	out_err->ok = true;
-	
-	return PrintToFile(data, out_err, GetStdHandle(STD_ERROR_HANDLE));
-}
-
-API bool
-OS_PrintStdout(String data, Arena* scratch_arena, OS_Error* out_err)
-{
-	Mem_Set(out_err, 0, sizeof(*out_err));
-	out_err->ok = true;
-	
-	return PrintToFile(data, out_err, GetStdHandle(STD_OUTPUT_HANDLE));
-}
@@ -0,0 +1,23 @@
+// aaa -DPLAIN -DVALUE=42 '-DFUNC(x)=((x)+1)' -DGONE -UGONE -ULATE -DLATE=1 -D__STDC_VERSION__=201112L -U__STDC_HOSTED__ '-DBAD(x)=#y x' tests/pp-cmdline-test.c -o tests/pp-cmdline-tested.c
+// NOTE: Every -U is applied after every -D, no matter the order they were given in.
+int plain = PLAIN;
+int value = VALUE;
+int func = FUNC(VALUE);
+
+#ifdef GONE
+#error GONE was undefined
+#endif
+
+#ifdef LATE
+#error LATE is undefined, even though it was defined later
+#endif
+
+long version = __STDC_VERSION__;
+int stdc = __STDC__;
+
+#ifndef __STDC_HOSTED__
+int not_hosted;
+#endif
+
+// NOTE: Fails with "expected a macro parameter.", just like the same #define would in a source file.
+int bad = BAD(1);
@@ -0,0 +1,14 @@
+# 3 "tests/pp-cmdline-test.c"
+int plain = 1;
+int value = 42;
+int func = ((42)+1);
+# 15 "tests/pp-cmdline-test.c"
+long version = 201112L;
+int stdc = 1;
+
+
+int not_hosted;
+
+
+
+int bad =y 1;
\ No newline at end of file
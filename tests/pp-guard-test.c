@@ -0,0 +1,12 @@
+// aaa tests/pp-guard-test.c -o tests/pp-guard-tested.c
+#include "pp-guard.h"
+#include "pp-guard.h"
+
+// NOTE: Once the guard macro is gone, the header has to be entered again.
+#undef PP_GUARD_H
+#include "pp-guard.h"
+#include "pp-guard.h"
+
+#ifdef PP_GUARD_H
+int guard_is_defined;
+#endif
@@ -0,0 +1,6 @@
+# 5 "tests/pp-guard.h"
+int guarded_value = 1;
+# 5 "tests/pp-guard.h"
+int guarded_value = 1;
+# 11 "tests/pp-guard-test.c"
+int guard_is_defined;
\ No newline at end of file
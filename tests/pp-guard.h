@@ -0,0 +1,7 @@
+// Included by tests/pp-guard-test.c.
+#ifndef PP_GUARD_H
+#define PP_GUARD_H
+
+int guarded_value = 1;
+
+#endif // PP_GUARD_H
@@ -0,0 +1,25 @@
+// aaa tests/pp-macros-test.c -o tests/pp-macros-tested.c
+#define A 1
+#define B 2
+#define C 3
+#undef B
+#undef NEVER_DEFINED
+
+// NOTE: Removing B must not hide the macros after it.
+int a = A, c = C;
+#if defined(B) || !defined(A) || !defined(C)
+#error wrong macro table state
+#endif
+
+// NOTE: Names can be reused, even with a different kind of macro.
+#define B(x) (x * 2)
+int b = B(A);
+#undef B
+#define B 4
+int b2 = B;
+
+#undef A
+#undef B
+#undef C
+#define C 5
+int left = A + B + C;
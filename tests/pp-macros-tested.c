@@ -0,0 +1,9 @@
+# 9 "tests/pp-macros-test.c"
+int a = 1, c = 3;
+# 16 "tests/pp-macros-test.c"
+int b = (1 * 2);
+
+
+int b2 = 4;
+# 25 "tests/pp-macros-test.c"
+int left = A + B + 5;
\ No newline at end of file
@@ -0,0 +1,9 @@
+// aaa tests/pp-once-test.c -o tests/pp-once-tested.c
+#include "pp-once.h"
+#include "pp-once.h"
+// NOTE: A different path to the same file.
+#include "../tests/pp-once.h"
+
+#define DO_PRAGMA(x) _Pragma(#x)
+DO_PRAGMA(pack(push, 1)) struct packed { char c; int i; };
+_Pragma("pack(pop)")
@@ -0,0 +1,6 @@
+# 4 "tests/pp-once.h"
+int once_value = 1;
+# 8 "tests/pp-once-test.c"
+#pragma pack(push, 1)
+ struct packed { char c; int i; };
+#pragma pack(pop)
\ No newline at end of file
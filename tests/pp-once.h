@@ -0,0 +1,4 @@
+// Included by tests/pp-once-test.c.
+#pragma once
+
+int once_value = 1;
@@ -0,0 +1,36 @@
+// aaa tests/pp-skip-test.c -o tests/pp-skip-tested.c
+#if 0
+Junk that isn't valid C: @ ` \ $@ @@
+foo \
+bar
+it's an unclosed quote
+#  if 1
+#    error nested groups are skipped too
+#  endif
+#elif 1
+int first_taken = 1;
+#else
+@ never
+#endif
+
+#ifdef NOT_DEFINED
+` \ x
+#else
+int second_taken = 2;
+#endif
+
+#if 1
+int third_taken = 3;
+#elif @
+#endif
+
+int total = first_taken + second_taken + third_taken;
+
+// NOTE: Errors even though the group is skipped: "#elif after #else." and "#else after #else.".
+#if 1
+int fourth_taken = 4;
+#else
+@ skipped
+#elif 1
+#else
+#endif
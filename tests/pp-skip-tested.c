@@ -0,0 +1,16 @@
+# 11 "tests/pp-skip-test.c"
+int first_taken = 1;
+# 19 "tests/pp-skip-test.c"
+int second_taken = 2;
+
+
+
+int third_taken = 3;
+
+
+
+int total = first_taken + second_taken + third_taken;
+
+
+
+int fourth_taken = 4;
\ No newline at end of file
@@ -9,7 +9,7 @@ int an_int = 0xffffULL;
 float a_float = 35.0f;
 float wtf = 0x8080.0p+3f;
 
-const char* a_string = "pepe, " STR(MY_MACRO) " is " STR2(MY_MACRO);
+const char* a_string = "pepe, ""MY_MACRO" " is ""hello";
 # 37 "tests/pp-test.c"
 int a = "HI THERE";
 int b = HI_THERE;
@@ -27,4 +27,6 @@ int main(int argc, char* argv[])
 
  pp[1] = &argc;
 
-) printf("address of 'f' is %p\n", pp[0]); LOG("this is line " STR2(__LINE__) "!\n");})
\ No newline at end of file
+ printf("address of 'f' is %p\n", pp[0]);
+ printf("this is line ""58" "!\n");
+}
\ No newline at end of file